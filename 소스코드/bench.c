@@ -0,0 +1,554 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include "core.h"
+#include "daemon.h"
+
+// 기본 최대 엔트리 수
+#define BENCH_MAX_N 1000000
+
+#define USAGE "usage: %s [-n max_entries]\n" \
+	"       %s -l [-n entries] [-m minutes] [-d density%%] [-s job_sleep] [-j max_jobs] [-x speed]\n"
+
+// 파서 벤치마크 반복 횟수
+#define BENCH_PARSE_ITERS 200000
+
+// 한 엔트리 수에서 시뮬레이션할 총 작업량 (틱 수 x 엔트리 수)
+#define BENCH_TICK_BUDGET 20000000L
+
+// 부하 테스트 설정
+typedef struct load_opts {
+	int entries;		// crontab 엔트리 수
+	int minutes;		// 시뮬레이션할 분 수
+	double density;		// 엔트리 하나가 실행되는 분의 비율 (%)
+	double job_sleep;	// 명령어가 잠드는 실제 시간 (초), 0 이면 바로 끝나는 명령어
+	int max_jobs;		// 동시 실행 수 제한
+	double speed;		// 실제 1초 동안 흐르는 가상 시간 (초)
+} load_opts;
+
+int bench_parse();
+int load_test(const load_opts *opts);
+int gen_load_crontab(const load_opts *opts, unsigned int seed);
+int sim_clock(struct timespec *ts);
+void record_launch(const job_run *run);
+int bench_table(int n);
+int gen_crontab_file(int n, unsigned int seed);
+int append_crontab_line(unsigned int seed);
+double now_ns();
+int cmp_double(const void *lhs, const void *rhs);
+double percentile(const double *sorted, int n, double p);
+size_t arena_bytes(const arena *a);
+
+// 부하 테스트의 가상 시계 기준점
+static time_t sim_base;
+static double sim_start;
+static double sim_speed;
+
+// 부하 테스트 중 모은 실행 기록
+static double *lateness;
+static int launches, launch_cap;
+static int peak_running;
+
+// 파서 벤치마크에 사용할 주기 문자열
+static const char *parse_exprs[] = {
+	"*", "*/5", "1-59/2", "17", "1-5,10-20/2,30",
+	"0,2,4,6,8,10,12,14,16,18,20,22,24,26,28,30,32,34,36,38,40,42,44,46,48,50,52,54,56,58",
+	NULL
+};
+
+// 결과를 stdout 에 한 줄짜리 JSON 으로 출력함
+int main(int argc, char *argv[]) {
+	char dir[] = "/tmp/ssu_bench.XXXXXX";
+	load_opts opts = { 10000, 1440, 1.0, 0.0, DEFAULT_MAX_JOBS, 3600.0 };
+	int max_n = BENCH_MAX_N;
+	int load = 0, op;
+
+	while ((op = getopt(argc, argv, "ln:m:d:s:j:x:")) != -1) {
+		switch (op) {
+			case 'l':
+				load = 1;
+				break;
+
+			case 'n':
+				max_n = opts.entries = atoi(optarg);
+				break;
+
+			case 'm':
+				opts.minutes = atoi(optarg);
+				break;
+
+			case 'd':
+				opts.density = atof(optarg);
+				break;
+
+			case 's':
+				opts.job_sleep = atof(optarg);
+				break;
+
+			case 'j':
+				opts.max_jobs = atoi(optarg);
+				break;
+
+			case 'x':
+				opts.speed = atof(optarg);
+				break;
+
+			default:
+				fprintf(stderr, USAGE, argv[0], argv[0]);
+				exit(1);
+		}
+	}
+
+	if (max_n <= 0 || opts.minutes <= 0 || opts.density <= 0 || opts.density > 100
+			|| opts.job_sleep < 0 || opts.max_jobs <= 0 || opts.speed <= 0) {
+		fprintf(stderr, USAGE, argv[0], argv[0]);
+		exit(1);
+	}
+
+	// 벤치마크 중 만드는 파일들이 작업 디렉토리를 더럽히지 않도록 임시 디렉토리에서 실행
+	if (mkdtemp(dir) == NULL || chdir(dir) < 0) {
+		fprintf(stderr, "mkdtemp error\n");
+		exit(1);
+	}
+
+	init_crontab_table(&table);
+
+	if (load) {
+		if (load_test(&opts) < 0) {
+			fprintf(stderr, "%s\n", err_str);
+			exit(1);
+		}
+	} else {
+		// 실행 대기 큐에만 넣고 실제로 실행하지는 않음
+		max_jobs = 0;
+		bench_parse();
+		for (int n = 1000; n <= max_n; n *= 10) {
+			if (bench_table(n) < 0) {
+				fprintf(stderr, "%s\n", err_str);
+				exit(1);
+			}
+		}
+	}
+
+	log_flush();
+	unlink(CRONTAB_FILE);
+	unlink(CRONTAB_CACHE);
+	unlink(CRONTAB_LOG);
+	rmdir(dir);
+	exit(0);
+}
+
+/**
+  주기 문자열 파서의 처리량을 측정하는 함수
+  기존 값별 평가(parse_execute_term)와 한 번에 마스크를 만드는 parse_term 을 비교함
+  */
+int bench_parse() {
+	term_result res;
+	double start, elapsed;
+	volatile int sink = 0;
+
+	for (int i = 0; parse_exprs[i] != NULL; i++) {
+		start = now_ns();
+		for (int k = 0; k < BENCH_PARSE_ITERS; k++)
+			parse_term(parse_exprs[i], &res), sink += res.mask & 1;
+		elapsed = now_ns() - start;
+		printf("{\"bench\":\"parse\",\"api\":\"parse_term\",\"expr\":\"%s\",\"ns_per_op\":%.1f}\n",
+				parse_exprs[i], elapsed / BENCH_PARSE_ITERS);
+
+		// 값 0~59 를 하나씩 평가해야 마스크 하나와 같은 정보가 됨
+		start = now_ns();
+		for (int k = 0; k < BENCH_PARSE_ITERS / 60; k++) {
+			for (int v = 0; v < 60; v++)
+				sink += parse_execute_term(parse_exprs[i], v);
+		}
+		elapsed = now_ns() - start;
+		printf("{\"bench\":\"parse\",\"api\":\"parse_execute_term_x60\",\"expr\":\"%s\",\"ns_per_op\":%.1f}\n",
+				parse_exprs[i], elapsed / (BENCH_PARSE_ITERS / 60));
+	}
+
+	fflush(stdout);
+	return 0;
+}
+
+/**
+  엔트리 n 개짜리 crontab 으로 로드, reload, 틱 처리 시간을 측정하는 함수
+  @param n 엔트리 수
+  @return 성공 시 0, 에러 시 -1
+  */
+int bench_table(int n) {
+	crontab_table t;
+	crontab *ct;
+	job_run *run;
+	struct tm tm;
+	double start, uncached, cached, reload_same, reload_append;
+	int scheds;
+	double *lat, *scan, *simd;
+	crontab_columns cols;
+	time_t base, when;
+	long due = 0, vectored = 0;
+	int ticks, matched = 0, *idx;
+	size_t bytes;
+
+	if (gen_crontab_file(n, 20162489 + n) < 0)
+		return -1;
+	unlink(CRONTAB_CACHE);
+
+	// 캐시 없이 파싱과 컴파일을 하고 캐시를 쓰는 로드
+	init_crontab_table(&t);
+	start = now_ns();
+	if (read_crontab_file(&t) < 0)
+		return -1;
+	uncached = now_ns() - start;
+	bytes = arena_bytes(&t.arena);
+	scheds = t.sched_count;
+	free_crontab_table(&t);
+
+	// 방금 쓴 캐시에서 읽는 로드
+	init_crontab_table(&t);
+	start = now_ns();
+	if (read_crontab_file(&t) < 0)
+		return -1;
+	cached = now_ns() - start;
+	free_crontab_table(&t);
+
+	printf("{\"bench\":\"load\",\"n\":%d,\"schedules\":%d,\"uncached_ms\":%.3f,\"cached_ms\":%.3f,"
+			"\"bytes_per_entry\":%.1f}\n", n, scheds, uncached / 1e6, cached / 1e6, (double) bytes / n);
+	fflush(stdout);
+
+	// daemon 테이블을 비우고 다시 채움
+	free_crontab_table(&table);
+	init_crontab_table(&table);
+	heap_size = 0;
+	base = time(NULL) / 60 * 60 + 86400;
+	if (reload_crontab(base) < 0)
+		return -1;
+
+	// 바뀐 것이 없는 reload 와 한 줄이 추가된 reload
+	start = now_ns();
+	if (reload_crontab(base) < 0)
+		return -1;
+	reload_same = now_ns() - start;
+
+	if (append_crontab_line(n) < 0)
+		return -1;
+	start = now_ns();
+	if (reload_crontab(base) < 0)
+		return -1;
+	reload_append = now_ns() - start;
+
+	printf("{\"bench\":\"reload\",\"n\":%d,\"unchanged_ms\":%.3f,\"append_one_ms\":%.3f}\n",
+			n, reload_same / 1e6, reload_append / 1e6);
+	fflush(stdout);
+
+	// 틱 처리 시간 (미래 시각으로 시뮬레이션해서 catchup 로그가 남지 않도록 함)
+	if ((ticks = BENCH_TICK_BUDGET / n) > 1440)
+		ticks = 1440;
+	if (ticks < 30)
+		ticks = 30;
+	lat = malloc(sizeof(double) * ticks);
+	scan = malloc(sizeof(double) * ticks);
+	simd = malloc(sizeof(double) * ticks);
+	reschedule_all(base);
+	if (build_crontab_columns(&cols, &table) < 0)
+		return -1;
+	idx = malloc(sizeof(int) * cols.count);
+
+	for (int i = 0; i < ticks; i++) {
+		when = base + (time_t) i * 60;
+
+		start = now_ns();
+		dispatch_due(when);
+		lat[i] = now_ns() - start;
+
+		// 대기 큐에 쌓인 실행을 비움
+		while ((run = queue_pop(&pending)) != NULL) {
+			free(run->desc);
+			free(run);
+			due++;
+		}
+
+		// 예전 방식처럼 매 분 모든 엔트리를 검사하는 경우
+		start = now_ns();
+		localtime_r(&when, &tm);
+		for (ct = table.head.next; ct != NULL; ct = ct->next)
+			matched += match_crontab(ct, &tm);
+		scan[i] = now_ns() - start;
+
+		// 마스크 배열을 SIMD 로 훑는 경우
+		start = now_ns();
+		for (int k = due_crontab_columns(&cols, &tm, idx) - 1; k >= 0; k--)
+			vectored += cols.scheds[idx[k]]->job_count;
+		simd[i] = now_ns() - start;
+	}
+	free(idx);
+	free_crontab_columns(&cols);
+
+	qsort(lat, ticks, sizeof(double), cmp_double);
+	qsort(scan, ticks, sizeof(double), cmp_double);
+	qsort(simd, ticks, sizeof(double), cmp_double);
+	printf("{\"bench\":\"tick\",\"n\":%d,\"ticks\":%d,\"jobs_per_tick\":%.1f,"
+			"\"heap_p50_us\":%.2f,\"heap_p99_us\":%.2f,\"heap_max_us\":%.2f,"
+			"\"scan_p50_us\":%.2f,\"scan_p99_us\":%.2f,\"scan_max_us\":%.2f,"
+			"\"simd_p50_us\":%.2f,\"simd_p99_us\":%.2f,\"simd_max_us\":%.2f}\n",
+			n, ticks, (double) due / ticks,
+			percentile(lat, ticks, 50) / 1e3, percentile(lat, ticks, 99) / 1e3, lat[ticks - 1] / 1e3,
+			percentile(scan, ticks, 50) / 1e3, percentile(scan, ticks, 99) / 1e3, scan[ticks - 1] / 1e3,
+			percentile(simd, ticks, 50) / 1e3, percentile(simd, ticks, 99) / 1e3, simd[ticks - 1] / 1e3);
+	fflush(stdout);
+
+	free(lat);
+	free(scan);
+	free(simd);
+
+	// 세 방식이 같은 수의 실행을 찾아야 함
+	if (matched != due || vectored != due) {
+		sprintf(err_str, "tick mismatch: heap %ld, scan %d, simd %ld\n", due, matched, vectored);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+  가상 시계로 daemon 스케줄러를 돌려서 실제 명령어 실행 부하를 측정하는 함수
+  가상 시계는 실제 시간보다 speed 배 빠르게 흐르므로 하루치 스케줄을 몇 십 초 안에 확인할 수 있음
+  실행 지연은 원래 실행 시각과 실제로 실행된 가상 시각의 차이
+  @param opts 부하 테스트 설정
+  @return 성공 시 0, 에러 시 -1
+  */
+int load_test(const load_opts *opts) {
+	struct pollfd pfd;
+	sigset_t mask;
+	time_t now, end;
+	double elapsed, wait;
+	int (*real_clock)(struct timespec *ts) = daemon_clock;
+	int sfd, timeout;
+
+	if (gen_load_crontab(opts, 20162489) < 0)
+		return -1;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	if ((sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+		sprintf(err_str, "signalfd error\n");
+		return -1;
+	}
+
+	// 스케줄러가 늦어져도 놓친 실행을 버리지 않고 얼마나 늦었는지 측정함
+	max_jobs = opts->max_jobs;
+	catchup_window = opts->minutes;
+	launch_hook = record_launch;
+
+	sim_base = time(NULL) / 60 * 60 + 60;
+	end = sim_base + (time_t) opts->minutes * 60;
+	if (reload_crontab(sim_base - 1) < 0)
+		return -1;
+
+	sim_speed = opts->speed;
+	sim_start = now_ns();
+	daemon_clock = sim_clock;
+
+	pfd.fd = sfd;
+	pfd.events = POLLIN;
+
+	while (1) {
+		now = daemon_time();
+		dispatch_due(now < end ? now : end - 1);
+		if (now >= end && running_count == 0 && pending.count == 0 && delayed.count == 0)
+			break;
+
+		// 다음 실행 시각까지 실제 시간으로 환산해서 대기
+		timeout = 100;
+		if (now < end && heap_size > 0 && heap[0]->next_run < end) {
+			wait = (heap[0]->next_run - now) / sim_speed * 1000;
+			timeout = wait < timeout ? (int) wait : timeout;
+		}
+		if (delayed.count > 0) {
+			wait = (delayed.items[0]->release - now) / sim_speed * 1000;
+			wait = wait < 0 ? 0 : wait;
+			timeout = wait < timeout ? (int) wait : timeout;
+		}
+
+		if (poll(&pfd, 1, timeout) > 0)
+			reap_children(sfd);
+	}
+	elapsed = (now_ns() - sim_start) / 1e9;
+
+	daemon_clock = real_clock;
+	launch_hook = NULL;
+	close(sfd);
+
+	qsort(lateness, launches, sizeof(double), cmp_double);
+	printf("{\"bench\":\"load\",\"entries\":%d,\"minutes\":%d,\"density_pct\":%.2f,"
+			"\"job_sleep\":%.3f,\"max_jobs\":%d,\"speed\":%.1f,\"launches\":%d,"
+			"\"elapsed_sec\":%.3f,\"launches_per_sec\":%.1f,\"peak_running\":%d,"
+			"\"late_p50_sec\":%.3f,\"late_p90_sec\":%.3f,\"late_p99_sec\":%.3f,\"late_max_sec\":%.3f}\n",
+			opts->entries, opts->minutes, opts->density, opts->job_sleep, opts->max_jobs,
+			opts->speed, launches, elapsed, launches / elapsed, peak_running,
+			launches ? percentile(lateness, launches, 50) : 0,
+			launches ? percentile(lateness, launches, 90) : 0,
+			launches ? percentile(lateness, launches, 99) : 0,
+			launches ? lateness[launches - 1] : 0);
+	fflush(stdout);
+
+	free(lateness);
+	return 0;
+}
+
+/**
+  엔트리 하나가 전체 분 중 density % 에서 실행되는 crontab 파일을 만드는 함수
+  실행되는 분은 엔트리마다 다르게 흩어 놓음
+  @param opts 부하 테스트 설정
+  @param seed 난수 seed
+  @return 성공 시 0, 에러 시 -1
+  */
+int gen_load_crontab(const load_opts *opts, unsigned int seed) {
+	char min[BUF_SIZE], cmd[SM_BUF_SIZE];
+	FILE *fp;
+	int step, len;
+
+	if ((step = (int) (100 / opts->density + 0.5)) > 60)
+		step = 60;
+	if (opts->job_sleep > 0)
+		sprintf(cmd, "sleep %.3f", opts->job_sleep);
+	else
+		strcpy(cmd, "true");
+
+	if ((fp = fopen(CRONTAB_FILE, "w")) == NULL) {
+		sprintf(err_str, "fopen error for %s\n", CRONTAB_FILE);
+		return -1;
+	}
+
+	srand(seed);
+	for (int i = 0; i < opts->entries; i++) {
+		if (step <= 1) {
+			strcpy(min, "*");
+		} else {
+			len = 0;
+			for (int m = rand() % step; m < 60; m += step)
+				len += sprintf(min + len, len ? ",%d" : "%d", m);
+		}
+		fprintf(fp, "%s * * * * %s\n", min, cmd);
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/**
+  부하 테스트용 가상 시계, sim_base 부터 실제 시간의 sim_speed 배로 흐름
+  */
+int sim_clock(struct timespec *ts) {
+	double sim = (now_ns() - sim_start) / 1e9 * sim_speed;
+
+	ts->tv_sec = sim_base + (time_t) sim;
+	ts->tv_nsec = (long) ((sim - (time_t) sim) * 1e9);
+	return 0;
+}
+
+/**
+  명령어가 실행될 때마다 실행 지연과 동시 실행 수를 기록하는 함수
+  */
+void record_launch(const job_run *run) {
+	if (launches == launch_cap) {
+		launch_cap = launch_cap ? launch_cap * 2 : 1024;
+		lateness = realloc(lateness, sizeof(double) * launch_cap);
+	}
+
+	lateness[launches++] = run->launched.tv_sec - run->sched + run->launched.tv_nsec / 1e9;
+	if (running_count > peak_running)
+		peak_running = running_count;
+}
+
+/**
+  주어진 seed 로 항상 같은 내용의 crontab 파일을 만드는 함수
+  @param n 엔트리 수
+  @param seed 난수 seed
+  @return 성공 시 0, 에러 시 -1
+  */
+int gen_crontab_file(int n, unsigned int seed) {
+	static const char *mins[] = { "*", "*/5", "1-59/2", "0,15,30,45", "%d", "%d-%d" };
+	static const char *hours[] = { "*", "*/2", "9-17", "%d" };
+	static const char *days[] = { "*", "*", "*", "%d" };
+	static const char *dows[] = { "*", "*", "1-5", "0,6" };
+	char min[SM_BUF_SIZE], hour[SM_BUF_SIZE], day[SM_BUF_SIZE];
+	FILE *fp;
+	int a;
+
+	if ((fp = fopen(CRONTAB_FILE, "w")) == NULL) {
+		sprintf(err_str, "fopen error for %s\n", CRONTAB_FILE);
+		return -1;
+	}
+
+	srand(seed);
+	for (int i = 0; i < n; i++) {
+		a = rand() % 50;
+		sprintf(min, mins[rand() % 6], a, a + 9);
+		sprintf(hour, hours[rand() % 4], rand() % 24);
+		sprintf(day, days[rand() % 4], rand() % 28 + 1);
+		fprintf(fp, "%s %s %s * %s echo job %d\n", min, hour, day, dows[rand() % 4], i);
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/**
+  crontab 파일 끝에 엔트리 하나를 추가하는 함수
+  @param seed 추가할 엔트리를 구분하는 값
+  @return 성공 시 0, 에러 시 -1
+  */
+int append_crontab_line(unsigned int seed) {
+	FILE *fp;
+
+	if ((fp = fopen(CRONTAB_FILE, "a")) == NULL) {
+		sprintf(err_str, "fopen error for %s\n", CRONTAB_FILE);
+		return -1;
+	}
+
+	fprintf(fp, "*/5 * * * * echo appended %u\n", seed);
+	fclose(fp);
+	return 0;
+}
+
+/**
+  단조 시계의 현재 시각을 ns 단위로 구하는 함수
+  */
+double now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int cmp_double(const void *lhs, const void *rhs) {
+	double l = *(const double *) lhs, r = *(const double *) rhs;
+
+	return (l > r) - (l < r);
+}
+
+/**
+  정렬된 배열에서 p 백분위 값을 구하는 함수
+  */
+double percentile(const double *sorted, int n, double p) {
+	int idx = (int) (p / 100 * (n - 1) + 0.5);
+
+	return sorted[idx];
+}
+
+/**
+  arena 가 실제로 사용 중인 바이트 수를 구하는 함수
+  */
+size_t arena_bytes(const arena *a) {
+	size_t bytes = 0;
+
+	for (const arena_chunk *chunk = a->chunks; chunk != NULL; chunk = chunk->next)
+		bytes += chunk->used;
+	return bytes;
+}
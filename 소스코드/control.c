@@ -0,0 +1,831 @@
+// accept4
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include "core.h"
+#include "daemon.h"
+#include "metrics.h"
+#include "control.h"
+
+// 제어 소켓 경로 (NULL 이면 제어 소켓을 열지 않음)
+const char *control_socket = CONTROL_SOCKET;
+
+// 스케줄러가 파일에 쓸 변경이나 다시 읽기 요청이 생겼음을 reload 스레드에 알리는 eventfd
+int ctl_fd = -1;
+
+// reload 스레드가 파일에 쓴 마지막 변경 번호
+_Atomic unsigned long ctl_persisted;
+
+// 저널에 쓸 변경들 (스케줄러가 앞에 넣고 reload 스레드가 한 번에 가져감, 새것이 앞)
+static ctl_change *_Atomic unwritten;
+
+// 다른 프로세스가 저널 끝에 붙인 기록들 (reload 스레드가 앞에 넣고 스케줄러가 한 번에 가져감, 새것이 앞)
+static ctl_change *_Atomic incoming;
+
+// 다시 읽기 요청이 있었으면 1
+static atomic_int reload_requested;
+
+// 현재 테이블에 반영했지만 파일에는 아직 없을 수 있는 변경들 (스케줄러 스레드, 오래된 것이 앞)
+// 이 변경들이 빠진 파일로 만든 테이블을 가져오면 다시 반영함
+static ctl_change *replay_head, *replay_tail;
+
+// 마지막으로 반영한 변경 번호 (스케줄러 스레드)
+static unsigned long change_seq;
+
+// 제어 스레드가 받은 요청 하나와 스케줄러가 만든 응답
+// 제어 스레드는 한 번에 연결 하나만 처리하므로 요청도 한 번에 하나만 있음
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	int state;					// CTL_IDLE, CTL_WAITING, CTL_ANSWERED
+	ctl_header hdr;				// 요청
+	char *body;
+	int type;					// 응답
+	char *reply;
+	size_t len;
+} mailbox = { .lock = PTHREAD_MUTEX_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+// 제어 스레드가 스케줄러에 요청이 들어왔음을 알리는 eventfd
+static int request_fd = -1;
+
+/**
+  제어 소켓을 만들어 연결을 기다리는 함수 (다른 스레드를 만들기 전에 부름)
+  다른 ssu_crond 가 쓰고 있는 소켓이면 에러, 죽은 ssu_crond 가 남긴 소켓 파일이면 지우고 새로 만듦
+  @param path 제어 소켓 경로
+  @return 성공 시 소켓, 에러 시 -1 리턴하고 err_str 설정
+  */
+int ctl_listen(const char *path) {
+	struct sockaddr_un addr;
+	mode_t old;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		sprintf(err_str, "[control] socket path is too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		sprintf(err_str, "[control] socket error\n");
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+		sprintf(err_str, "[control] %s is in use by another ssu_crond\n", path);
+		close(fd);
+		return -1;
+	}
+	unlink(path);
+
+	// 소켓 파일은 처음부터 소유자만 연결할 수 있게 만듦
+	old = umask(077);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		umask(old);
+		sprintf(err_str, "[control] bind error for %s\n", path);
+		close(fd);
+		return -1;
+	}
+	umask(old);
+
+	if (listen(fd, SOMAXCONN) < 0 || (ctl_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		sprintf(err_str, "[control] listen error for %s\n", path);
+		unlink(path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+  엔트리를 "분 시 일 월 요일 명령어" 문자열로 만드는 함수 (crontab 파일의 한 줄과 같은 형식)
+  @param ct crontab 노드
+  @return 새로 할당한 문자열, 에러 시 NULL 리턴하고 err_str 설정
+  */
+static char *__entry_line(const crontab *ct) {
+	const schedule *sp = ct->sched;
+	char *line;
+	int len;
+
+	len = snprintf(NULL, 0, "%s %s %s %s %s %s", sp->min, sp->hour, sp->day, sp->month, sp->dayofweek, ct->op);
+	if ((line = malloc(len + 1)) == NULL) {
+		sprintf(err_str, "[control] out of memory\n");
+		return NULL;
+	}
+	sprintf(line, "%s %s %s %s %s %s", sp->min, sp->hour, sp->day, sp->month, sp->dayofweek, ct->op);
+	return line;
+}
+
+/**
+  remove 요청의 "번호 분 시 일 월 요일 명령어" 로 현재 테이블에서 엔트리를 찾는 함수
+  목록을 받은 뒤에 다른 요청으로 바뀌었을 수 있으므로 번호와 내용이 모두 맞아야 함
+  @param body 요청 본문 (NULL 로 끝남)
+  @param line 찾은 엔트리의 "분 시 일 월 요일 명령어" 저장 (새로 할당, 찾지 못하면 NULL)
+  @return 찾은 노드, 없거나 내용이 다르거나 에러 시 NULL 리턴하고 err_str 설정
+  */
+static crontab *__find_entry(const char *body, char **line) {
+	crontab *ct;
+	unsigned long id;
+	char *end;
+
+	*line = NULL;
+	sprintf(err_str, "entry has changed, list again\n");
+	id = strtoul(body, &end, 10);
+	if (end == body || *end != ' ' || id == 0 || id > UINT32_MAX)
+		return NULL;
+	if ((ct = find_crontab(&table.head, id, NULL)) == NULL)
+		return NULL;
+
+	if ((*line = __entry_line(ct)) == NULL)
+		return NULL;
+	if (strcmp(*line, end + 1) != 0) {
+		free(*line);
+		*line = NULL;
+		return NULL;
+	}
+	return ct;
+}
+
+/**
+  add 요청의 "분 시 일 월 요일 명령어" 문자열을 검사하는 함수
+  @param line 추가할 엔트리
+  @return 문제 없으면 0, 잘못된 엔트리면 -1 리턴하고 err_str 설정
+  */
+static int __check_line(const char *line) {
+	const char *fields[5], *op;
+	char term[BUF_SIZE];
+	size_t lens[5];
+	term_result res;
+	job_opts opts;
+
+	if (split_crontab_line(line, line + strlen(line), fields, lens, &op) <= 0) {
+		sprintf(err_str, "usage: add <min> <hour> <day> <month> <dayofweek> <command>\n");
+		return -1;
+	}
+
+	for (int i = 0; i < 5; i++) {
+		snprintf(term, sizeof(term), "%.*s", (int) lens[i], fields[i]);
+		if (strspn(term, "1234567890*-,/") != lens[i]) {
+			snprintf(err_str, BUF_SIZE, "invalid character in %.100s\n", term);
+			return -1;
+		}
+		if (parse_term(term, &res) < 0) {
+			snprintf(err_str, BUF_SIZE, "%.100s\n%*s^ %s\n", term, res.errpos, "", res.errmsg);
+			return -1;
+		}
+	}
+	return parse_job_opts(op, &opts);
+}
+
+/**
+  현재 테이블에 엔트리를 추가하는 함수 (스케줄러 스레드)
+  새로 생긴 주기는 컴파일해서 힙에 넣고, 이미 있는 주기를 쓰면 그 주기의 다음 실행 시각을 따름
+  @param line "분 시 일 월 요일 명령어"
+  @param id 엔트리 번호, 0 이면 새 번호를 붙임
+  @param now 새로 생긴 주기의 다음 실행 시각 기준
+  @return 추가한 노드, 필드가 모자란 줄이면 NULL
+  */
+static crontab *__insert(const char *line, uint32_t id, time_t now) {
+	crontab *ct;
+	schedule *sp;
+
+	// reload 스레드가 현재 테이블을 읽는 동안에는 리스트와 주기 목록을 바꾸지 않음
+	pthread_mutex_lock(&table_lock);
+	if ((ct = new_crontab_line(&table, line, strlen(line))) == NULL) {
+		pthread_mutex_unlock(&table_lock);
+		return NULL;
+	}
+	ct->id = id != 0 ? id : table.next_id;
+	if (ct->id >= table.next_id)
+		table.next_id = ct->id + 1;
+	add_crontab(&table.head, ct);
+	table.count++;
+
+	sp = ct->sched;
+	if (sp->heap_idx < 0) {
+		compile_schedule(sp);
+		if ((sp->next_run = next_fire_time(sp, now)) >= 0)
+			heap_push(sp);
+	}
+	pthread_mutex_unlock(&table_lock);
+
+	metrics.dirty = 1;
+	return ct;
+}
+
+/**
+  현재 테이블에서 엔트리를 빼는 함수 (스케줄러 스레드)
+  엔트리가 없어진 주기도 다음 테이블을 가져올 때까지 힙에 남지만 실행할 명령어가 없으므로 실행되지 않음
+  @param ct 뺄 노드
+  */
+static void __apply_remove(crontab *ct) {
+	pthread_mutex_lock(&table_lock);
+	remove_crontab(ct);
+	table.count--;
+	pthread_mutex_unlock(&table_lock);
+	metrics.dirty = 1;
+}
+
+/**
+  기록 하나를 현재 테이블에 적용하는 함수 (스케줄러 스레드)
+  삭제할 엔트리는 번호로 찾고, 저널이 손으로 고친 파일에 대한 것이면 내용으로도 찾음
+  @param c 적용할 기록
+  @param now 새로 생긴 주기의 다음 실행 시각 기준
+  */
+static void __apply_change(const ctl_change *c, time_t now) {
+	crontab *ct;
+
+	if (c->type == JOURNAL_ADD)
+		__insert(c->line, c->id, now);
+	else if ((ct = find_crontab(&table.head, c->id, table.journal_stale ? c->line : NULL)) != NULL)
+		__apply_remove(ct);
+}
+
+/**
+  이미 파일에 쓰인 변경들을 다시 반영할 목록에서 버리는 함수 (스케줄러 스레드)
+  @param seq 이 번호까지의 변경은 버림
+  */
+static void __drop_replay(unsigned long seq) {
+	ctl_change *c;
+
+	while ((c = replay_head) != NULL && c->seq <= seq) {
+		replay_head = c->next;
+		free(c->line);
+		free(c);
+	}
+	if (replay_head == NULL)
+		replay_tail = NULL;
+}
+
+/**
+  lock-free 스택에 기록을 넣는 함수
+  */
+static void __push(ctl_change *_Atomic *stack, ctl_change *c) {
+	c->next = atomic_load(stack);
+	while (!atomic_compare_exchange_weak(stack, &c->next, c))
+		;
+}
+
+/**
+  lock-free 스택의 기록을 모두 꺼내서 들어온 순서로 뒤집는 함수
+  */
+static ctl_change *__take(ctl_change *_Atomic *stack) {
+	ctl_change *list, *c, *rev = NULL;
+
+	list = atomic_exchange(stack, NULL);
+	while ((c = list) != NULL) {
+		list = c->next;
+		c->next = rev;
+		rev = c;
+	}
+	return rev;
+}
+
+/**
+  기록 리스트를 해제하는 함수
+  */
+static void __free_changes(ctl_change *c) {
+	ctl_change *next;
+
+	for (; c != NULL; c = next) {
+		next = c->next;
+		free(c->line);
+		free(c);
+	}
+}
+
+/**
+  테이블에 반영한 변경을 다시 반영할 목록에 넣고 reload 스레드에 저널에 쓰도록 넘기는 함수 (스케줄러 스레드)
+  @param type JOURNAL_ADD 또는 JOURNAL_REMOVE
+  @param ct 추가하거나 뺀 엔트리
+  @param line 바뀐 엔트리 (새로 할당한 문자열, 실패해도 이 함수가 가져감)
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정 (아무것도 넘기지 않음)
+  */
+static int __record_change(int type, const crontab *ct, char *line) {
+	ctl_change *replay, *change;
+	uint64_t val = 1;
+
+	__drop_replay(atomic_load(&ctl_persisted));
+
+	// 저널에 쓸 기록을 모두 만든 뒤에 넘김
+	replay = malloc(sizeof(ctl_change));
+	change = malloc(sizeof(ctl_change));
+	if (replay == NULL || change == NULL || (change->line = strdup(line)) == NULL) {
+		sprintf(err_str, "[control] out of memory\n");
+		free(replay);
+		free(change);
+		free(line);
+		return -1;
+	}
+
+	replay->type = type;
+	replay->id = ct->id;
+	replay->seq = ++change_seq;
+	replay->line = line;
+	replay->next = NULL;
+	if (replay_tail != NULL)
+		replay_tail->next = replay;
+	else
+		replay_head = replay;
+	replay_tail = replay;
+
+	line = change->line;
+	*change = *replay;
+	change->line = line;
+	__push(&unwritten, change);
+	write(ctl_fd, &val, sizeof(val));
+	return 0;
+}
+
+/**
+  요청에 대한 응답을 mailbox 에 넣는 함수 (스케줄러 스레드)
+  @param type CTL_OK 또는 CTL_ERROR
+  @param body 응답 본문 (복사함, NULL 로 끝나게 함)
+  @param len 응답 본문 길이
+  @return 성공 시 0, 본문을 복사할 메모리가 없으면 본문 없는 CTL_ERROR 로 응답하고 -1 리턴, err_str 설정
+  */
+static int __reply(int type, const char *body, size_t len) {
+	if ((mailbox.reply = malloc(len + 1)) == NULL) {
+		sprintf(err_str, "[control] out of memory\n");
+		mailbox.type = CTL_ERROR;
+		mailbox.len = 0;
+		return -1;
+	}
+	mailbox.type = type;
+	if (len > 0)
+		memcpy(mailbox.reply, body, len);
+	mailbox.reply[len] = '\0';
+	mailbox.len = len;
+	return 0;
+}
+
+/**
+  err_str 을 에러 응답으로 넣는 함수 (스케줄러 스레드)
+  이미 넣어둔 응답이 있으면 버림
+  */
+static void __reply_error() {
+	free(mailbox.reply);
+	mailbox.reply = NULL;
+	__reply(CTL_ERROR, err_str, strlen(err_str));
+}
+
+/**
+  mailbox 의 제어 요청 하나를 처리하고 응답을 만드는 함수 (스케줄러 스레드)
+  소켓은 읽고 쓰지 않으므로 느린 클라이언트가 있어도 기다리지 않음
+  @param now 현재 시각
+  */
+static void __serve_request(time_t now) {
+	crontab *ct;
+	char *body = mailbox.body, *line, *reply, *grown, buf[BUF_SIZE];
+	size_t len = 0, cap;
+	uint64_t val = 1;
+
+	mailbox.reply = NULL;
+	switch (mailbox.hdr.type) {
+		case CTL_ADD:
+			if (__check_line(body) < 0 || (ct = __insert(body, 0, now)) == NULL) {
+				__reply_error();
+				break;
+			}
+
+			// 응답이나 저널 기록을 만들지 못하면 추가하지 않은 것으로 되돌림
+			if ((line = __entry_line(ct)) == NULL || __reply(CTL_OK, line, strlen(line)) < 0
+					|| __record_change(JOURNAL_ADD, ct, line) < 0) {
+				if (mailbox.reply == NULL)
+					free(line);
+				__apply_remove(ct);
+				__reply_error();
+				break;
+			}
+			snprintf(buf, sizeof(buf), "add %s\n", mailbox.reply);
+			log_crontab(buf);
+			break;
+
+		case CTL_REMOVE:
+			if ((ct = __find_entry(body, &line)) == NULL) {
+				__reply_error();
+				break;
+			}
+
+			// 응답과 저널 기록을 먼저 만들고, 실패하면 테이블을 바꾸지 않음
+			if (__reply(CTL_OK, line, strlen(line)) < 0) {
+				free(line);
+				__reply_error();
+				break;
+			}
+			if (__record_change(JOURNAL_REMOVE, ct, line) < 0) {
+				__reply_error();
+				break;
+			}
+			__apply_remove(ct);
+			snprintf(buf, sizeof(buf), "remove %s\n", mailbox.reply);
+			log_crontab(buf);
+			break;
+
+		case CTL_LIST:
+			cap = BUFSIZ;
+			if ((reply = malloc(cap)) == NULL) {
+				sprintf(err_str, "[control] out of memory\n");
+				__reply_error();
+				break;
+			}
+			for (ct = table.head.next; ct != NULL; ct = ct->next) {
+				if ((line = __entry_line(ct)) == NULL)
+					break;
+				while (len + strlen(line) + 13 > cap) {
+					if ((grown = realloc(reply, cap * 2)) == NULL)
+						break;
+					reply = grown;
+					cap *= 2;
+				}
+				if (len + strlen(line) + 13 > cap) {
+					sprintf(err_str, "[control] out of memory\n");
+					free(line);
+					break;
+				}
+				len += sprintf(reply + len, "%u %s\n", ct->id, line);
+				free(line);
+			}
+			if (ct != NULL) {
+				free(reply);
+				__reply_error();
+				break;
+			}
+			mailbox.type = CTL_OK;
+			mailbox.reply = reply;
+			mailbox.len = len;
+			break;
+
+		case CTL_RELOAD:
+			atomic_store(&reload_requested, 1);
+			write(ctl_fd, &val, sizeof(val));
+			__reply(CTL_OK, NULL, 0);
+			break;
+
+		default:
+			__reply(CTL_ERROR, "unknown request\n", 16);
+			break;
+	}
+}
+
+/**
+  제어 스레드가 넘긴 요청을 처리하는 함수 (스케줄러 스레드)
+  테이블을 바꾸는 요청도 스케줄러 스레드에서 처리하므로 실행 중인 스케줄과 충돌하지 않고,
+  응답을 보낸 시점에 이미 다음 실행 시각부터 적용되어 있음
+  소켓 읽기, 쓰기는 제어 스레드가 하므로 메모리 작업만 함
+  @param now 현재 시각
+  */
+void ctl_serve(time_t now) {
+	uint64_t count;
+
+	read(request_fd, &count, sizeof(count));
+	pthread_mutex_lock(&mailbox.lock);
+	if (mailbox.state == CTL_WAITING) {
+		__serve_request(now);
+		mailbox.state = CTL_ANSWERED;
+		pthread_cond_signal(&mailbox.done);
+	}
+	pthread_mutex_unlock(&mailbox.lock);
+}
+
+/**
+  제어 스레드의 main 함수
+  연결을 받아 요청을 읽고, 스케줄러가 처리한 응답을 보냄
+  느린 클라이언트는 이 스레드만 붙잡으며, 연결마다 읽기, 쓰기 시간을 CTL_IO_TIMEOUT 으로 제한함
+  @param arg ctl_listen 으로 만든 소켓 (intptr_t)
+  @return 리턴하지 않음
+  */
+static void *__control_main(void *arg) {
+	struct timeval tv = { CTL_IO_TIMEOUT / 1000, CTL_IO_TIMEOUT % 1000 * 1000 };
+	ctl_header hdr;
+	char *body;
+	uint64_t val = 1;
+	int lfd = (intptr_t) arg, fd;
+
+	while (1) {
+		if ((fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		if (ctl_recv(fd, &hdr, &body, CTL_MAX_BODY) < 0) {
+			close(fd);
+			continue;
+		}
+
+		pthread_mutex_lock(&mailbox.lock);
+		mailbox.hdr = hdr;
+		mailbox.body = body;
+		mailbox.state = CTL_WAITING;
+		write(request_fd, &val, sizeof(val));
+		while (mailbox.state != CTL_ANSWERED)
+			pthread_cond_wait(&mailbox.done, &mailbox.lock);
+		mailbox.state = CTL_IDLE;
+		pthread_mutex_unlock(&mailbox.lock);
+
+		ctl_send(fd, mailbox.type, mailbox.reply, mailbox.len);
+		free(mailbox.reply);
+		free(body);
+		close(fd);
+	}
+	return NULL;
+}
+
+/**
+  제어 스레드를 만드는 함수 (daemon_main, 시그널 마스크를 정한 뒤에 부름)
+  @param lfd ctl_listen 으로 만든 소켓
+  @return 스케줄러가 기다릴 eventfd (요청이 들어오면 ctl_serve 를 부름), 에러 시 -1 리턴하고 err_str 설정
+  */
+int ctl_start(int lfd) {
+	pthread_t tid;
+
+	if ((request_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		sprintf(err_str, "[control] eventfd error\n");
+		return -1;
+	}
+	if (pthread_create(&tid, NULL, __control_main, (void *) (intptr_t) lfd) != 0) {
+		sprintf(err_str, "[control] thread create error\n");
+		close(request_fd);
+		request_fd = -1;
+		return -1;
+	}
+	pthread_detach(tid);
+	return request_fd;
+}
+
+/**
+  새로 가져온 테이블에 아직 저널에 없던 변경들을 다시 반영하는 함수 (스케줄러 스레드)
+  @param seq 새 테이블을 읽을 때 저널에 쓰여 있던 마지막 변경 번호
+  @param now 새로 생긴 주기의 다음 실행 시각 기준
+  */
+void ctl_replay(unsigned long seq, time_t now) {
+	ctl_change *c;
+	crontab *ct;
+
+	__drop_replay(seq);
+	for (c = replay_head; c != NULL; c = c->next) {
+		if (c->type == JOURNAL_ADD)
+			__insert(c->line, c->id, now);
+		else if ((ct = find_crontab(&table.head, c->id, c->line)) != NULL)
+			__apply_remove(ct);
+	}
+}
+
+/**
+  reload 스레드가 저널 끝에서 읽어 넘긴 기록들을 현재 테이블에 적용하는 함수 (스케줄러 스레드)
+  새 테이블을 가져오기 전에 불러야 함 (새 테이블에는 이 기록들이 이미 들어있음)
+  @param now 새로 생긴 주기의 다음 실행 시각 기준
+  */
+void ctl_apply_incoming(time_t now) {
+	ctl_change *list, *c;
+
+	list = __take(&incoming);
+	for (c = list; c != NULL; c = c->next)
+		__apply_change(c, now);
+	__free_changes(list);
+}
+
+/**
+  파일이 마지막으로 확인한 상태 그대로인지 확인하는 함수
+  @param path 파일 경로
+  @param known 마지막으로 확인한 stat (st_ino 가 0 이면 확인한 적 없음)
+  @return 그대로면 1 아니면 0
+  */
+int file_unchanged(const char *path, const struct stat *known) {
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		return known->st_ino == 0;
+	return known->st_ino != 0 && st.st_ino == known->st_ino && st.st_size == known->st_size
+		&& st.st_mtim.tv_sec == known->st_mtim.tv_sec && st.st_mtim.tv_nsec == known->st_mtim.tv_nsec;
+}
+
+/**
+  ssu_crontab_file 과 저널의 지금 상태를 기록하는 함수 (reload 스레드)
+  테이블에 반영된 저널 길이는 바꾸지 않음
+  @param st 기록할 곳
+  */
+void store_refresh(store_state *st) {
+	if (stat(CRONTAB_FILE, &st->file) < 0)
+		memset(&st->file, 0, sizeof(st->file));
+	if (stat(CRONTAB_JOURNAL, &st->journal) < 0)
+		memset(&st->journal, 0, sizeof(st->journal));
+}
+
+/**
+  ssu_crontab_file 과 저널을 읽고 아직 쓰지 못한 변경들까지 적용한 테이블로 압축하는 함수 (reload 스레드)
+  @param rest 저널에 쓰지 못한 변경들 (들어온 순서)
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __compact_store(const ctl_change *rest) {
+	crontab_table t;
+	crontab *ct;
+	schedule *sp;
+	int ret;
+
+	// 파일이 아직 없으면 빈 테이블에서 시작
+	init_crontab_table(&t);
+	if (read_crontab_file_raw(&t) < 0) {
+		free_crontab_table(&t);
+		t.next_id = 1;
+	}
+
+	for (; rest != NULL; rest = rest->next) {
+		if (rest->type == JOURNAL_ADD) {
+			if ((ct = new_crontab_line(&t, rest->line, strlen(rest->line))) == NULL)
+				continue;
+			ct->id = rest->id;
+			if (ct->id >= t.next_id)
+				t.next_id = ct->id + 1;
+			add_crontab(&t.head, ct);
+			t.count++;
+		} else if ((ct = find_crontab(&t.head, rest->id, rest->line)) != NULL) {
+			remove_crontab(ct);
+			t.count--;
+		}
+	}
+
+	for (sp = t.scheds; sp != NULL; sp = sp->next)
+		compile_schedule(sp);
+	ret = compact_crontab(&t);
+	free_crontab_table(&t);
+	return ret;
+}
+
+/**
+  저널을 압축하는 함수 (reload 스레드, CRONTAB_LOCK 을 F_WRLCK 로 잡고 있어야 함)
+  @param st 마지막으로 확인한 ssu_crontab_file 과 저널 상태, 압축한 뒤의 상태로 바뀜
+  @return 스케줄러의 테이블에 없는 변경이 있어서 압축하지 않았으면 1 아니면 0
+  */
+static int __compact(store_state *st) {
+	if (!file_unchanged(CRONTAB_FILE, &st->file) || !file_unchanged(CRONTAB_JOURNAL, &st->journal)
+			|| st->journal.st_size != st->journal_len)
+		return 1;
+
+	if (__compact_store(NULL) < 0)
+		print_log(err_str);
+	store_refresh(st);
+	st->journal_len = st->journal.st_size;
+	return 0;
+}
+
+/**
+  저널을 압축하는 함수 (reload 스레드)
+  압축해도 내용과 엔트리 번호는 그대로이므로 스케줄러의 테이블은 다시 만들지 않음
+  @param st 마지막으로 확인한 ssu_crontab_file 과 저널 상태, 압축한 뒤의 상태로 바뀜
+  @return 다른 곳에서 고쳐서 파일을 다시 읽어야 하면 1 아니면 0
+  */
+int ctl_compact(store_state *st) {
+	int lfd, ret;
+
+	if ((lfd = lock_crontab(F_WRLCK)) < 0)
+		print_log(err_str);
+	ret = __compact(st);
+	unlock_crontab(lfd);
+	return ret;
+}
+
+/**
+  스케줄러가 넘긴 변경들을 저널에 쓰는 함수 (reload 스레드)
+  이 함수가 쓴 변경은 이미 스케줄러의 테이블에 들어있으므로 파일을 다시 읽지 않아도 되며,
+  쓰기 전에 파일이나 저널이 st 와 달라졌다면 다른 곳에서 고친 것이므로 다시 읽어야 함
+  저널이 없으면 압축해서 만들고, 저널이 충분히 커졌으면 압축함
+  @param st 마지막으로 확인한 ssu_crontab_file 과 저널 상태, 쓴 뒤의 상태로 바뀜
+  @return 파일을 다시 읽어야 하면 1 아니면 0
+  */
+int ctl_persist(store_state *st) {
+	ctl_change *list, *c;
+	off_t end;
+	ssize_t n;
+	int reload, lfd, compacted = 0;
+
+	reload = atomic_exchange(&reload_requested, 0);
+	if ((list = __take(&unwritten)) == NULL)
+		return reload;
+
+	// 확인하고 쓰는 동안 다른 프로세스가 끼어들지 못하도록 잠금
+	if ((lfd = lock_crontab(F_WRLCK)) < 0)
+		print_log(err_str);
+
+	if (!file_unchanged(CRONTAB_FILE, &st->file) || !file_unchanged(CRONTAB_JOURNAL, &st->journal))
+		reload = 1;
+
+	// 저널에 쓰는 사이에 다른 프로세스가 끼어들었으면 그 기록은 읽지 않았으므로 다시 읽어야 함
+	for (c = list; c != NULL; c = c->next) {
+		if ((n = append_crontab_journal(c->type, c->id, c->line, &end)) > 0) {
+			if (end != st->journal_len + n)
+				reload = 1;
+			st->journal_len = end;
+		} else if (n == 0) {
+			// 저널이 없으면 남은 변경들까지 적용해서 새로 만듦
+			if (__compact_store(c) < 0) {
+				print_log(err_str);
+				reload = 1;
+			}
+			compacted = 1;
+			while (c->next != NULL)
+				c = c->next;
+		} else if (n < 0) {
+			// 쓰지 못한 변경은 파일을 다시 읽어서 테이블에서도 없앰 (파일과 테이블이 달라지지 않게)
+			print_log(err_str);
+			reload = 1;
+		}
+		atomic_store(&ctl_persisted, c->seq);
+	}
+	__free_changes(list);
+
+	// 마지막으로 쓴 뒤에 다른 프로세스가 붙인 기록도 읽지 않았으므로 다시 읽어야 함
+	store_refresh(st);
+	if (compacted)
+		st->journal_len = st->journal.st_size;
+	else if (st->journal.st_size != st->journal_len)
+		reload = 1;
+	if (!reload && journal_full(st->journal_len, st->file.st_size))
+		reload = __compact(st);
+	unlock_crontab(lfd);
+	return reload;
+}
+
+/**
+  다른 프로세스가 저널 끝에 붙인 기록들만 읽어서 스케줄러에 넘기는 함수 (reload 스레드)
+  ssu_crontab_file 이 바뀌었거나 저널이 새로 만들어졌으면 (압축) 끝만 읽을 수 없으므로 다시 읽어야 함
+  @param st 마지막으로 확인한 ssu_crontab_file 과 저널 상태, 읽은 뒤의 상태로 바뀜
+  @return 넘긴 기록 수, 파일을 다시 읽어야 하면 -1
+  */
+int ctl_tail(store_state *st) {
+	struct stat js;
+	ctl_change *c;
+	const char *p, *eol, *end, *line;
+	char *buf;
+	uint32_t id;
+	ssize_t len;
+	int fd, lfd, type, count = 0;
+
+	// 압축 중이거나 쓰는 중인 저널을 읽지 않도록 잠금
+	if ((lfd = lock_crontab(F_RDLCK)) < 0) {
+		print_log(err_str);
+		return -1;
+	}
+
+	if (!file_unchanged(CRONTAB_FILE, &st->file) || stat(CRONTAB_JOURNAL, &js) < 0
+			|| js.st_ino != st->journal.st_ino || js.st_size < st->journal_len) {
+		unlock_crontab(lfd);
+		return -1;
+	}
+
+	if (js.st_size == st->journal_len) {
+		unlock_crontab(lfd);
+		st->journal = js;
+		return 0;
+	}
+
+	if ((fd = open(CRONTAB_JOURNAL, O_RDONLY | O_CLOEXEC)) < 0) {
+		unlock_crontab(lfd);
+		return -1;
+	}
+	if ((buf = malloc(js.st_size - st->journal_len)) == NULL) {
+		close(fd);
+		unlock_crontab(lfd);
+		return -1;
+	}
+	len = pread(fd, buf, js.st_size - st->journal_len, st->journal_len);
+	close(fd);
+	unlock_crontab(lfd);
+	if (len < 0) {
+		free(buf);
+		return -1;
+	}
+
+	// 끝에 개행이 없는 줄은 아직 쓰는 중인 기록이므로 다음에 읽음
+	end = buf + len;
+	for (p = buf; p < end && (eol = memchr(p, '\n', end - p)) != NULL; p = eol + 1) {
+		if ((type = parse_journal_record(p, eol, &id, &line)) < 0)
+			continue;
+		// 메모리가 모자라면 이 기록부터 다음에 다시 읽음
+		if ((c = malloc(sizeof(ctl_change))) == NULL || (c->line = strndup(line, eol - line)) == NULL) {
+			free(c);
+			break;
+		}
+		c->type = type;
+		c->id = id;
+		c->seq = 0;
+		__push(&incoming, c);
+		count++;
+	}
+
+	st->journal_len += p - buf;
+	st->journal = js;
+	free(buf);
+	return count;
+}
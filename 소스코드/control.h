@@ -0,0 +1,50 @@
+#ifndef H_CONTROL
+#define H_CONTROL 1
+
+#include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+// 제어 연결 하나를 읽고 쓸 때 기다리는 최대 시간 (밀리초)
+#define CTL_IO_TIMEOUT 1000
+
+// 제어 스레드와 스케줄러 사이의 요청 상태
+#define CTL_IDLE 0				// 요청 없음
+#define CTL_WAITING 1			// 스케줄러가 처리하기를 기다림
+#define CTL_ANSWERED 2			// 응답이 만들어짐
+
+// 제어 소켓이나 저널로 바뀐 엔트리 하나
+// 제어 소켓으로 바뀐 것은 스케줄러가 테이블에 바로 반영하고, 같은 내용을 reload 스레드가 나중에 저널에 씀
+// 다른 프로세스가 저널에 붙인 것은 reload 스레드가 읽어서 스케줄러에 넘김
+typedef struct ctl_change {
+	int type;					// JOURNAL_ADD 또는 JOURNAL_REMOVE
+	uint32_t id;				// 엔트리 번호
+	unsigned long seq;			// 제어 소켓으로 바뀐 순서 (1 부터, 저널에서 읽은 것은 0)
+	char *line;					// "분 시 일 월 요일 명령어"
+	struct ctl_change *next;
+} ctl_change;
+
+// reload 스레드가 마지막으로 확인한 ssu_crontab_file 과 저널 상태
+typedef struct store_state {
+	struct stat file;			// ssu_crontab_file (st_ino 가 0 이면 없음)
+	struct stat journal;		// 저널 (st_ino 가 0 이면 없음)
+	off_t journal_len;			// 스케줄러의 테이블에 반영된 저널 길이
+} store_state;
+
+extern const char *control_socket;
+extern int ctl_fd;
+extern _Atomic unsigned long ctl_persisted;
+
+int ctl_listen(const char *path);
+int ctl_start(int lfd);
+void ctl_serve(time_t now);
+void ctl_replay(unsigned long seq, time_t now);
+void ctl_apply_incoming(time_t now);
+int ctl_persist(store_state *st);
+int ctl_tail(store_state *st);
+int ctl_compact(store_state *st);
+void store_refresh(store_state *st);
+int file_unchanged(const char *path, const struct stat *known);
+
+#endif
@@ -1,408 +1,2922 @@
+// F_OFD_SETLKW
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "core.h"
 
-char exterm[BUFSIZ];
-char *extermp;
-int result = 0;
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+char err_str[BUF_SIZE];
+
+// OVERLAP_* 값의 이름
+const char *const overlap_names[] = { "allow", "skip", "queue", "kill", NULL };
+
+// CATCHUP_* 값의 이름
+const char *const catchup_names[] = { "none", "once", "all", NULL };
+
+// 주기 문자열 파서 상태 (호출자마다 따로 가지므로 스레드 간 공유되지 않음)
+typedef struct term_parser {
+	const char *str;	// 파싱 중인 문자열
+	const char *p;		// 현재 위치
+	int result;			// 0: 진행 중, -1: 에러
+	int errpos;
+	const char *errmsg;
+	uint64_t mask;		// 지금까지 파싱된 값들
+} term_parser;
+
+// 파일을 읽는 동안 같은 문자열을 한 번만 저장하기 위한 해시 테이블
+typedef struct intern_table {
+	const char **slots;
+	size_t size;	// 2의 거듭제곱
+	size_t count;
+} intern_table;
+
+// 컴파일된 crontab 캐시 파일 형식
+// [cache_header][cache_sched * sched_count][cache_entry * count][문자열 테이블]
+#define CACHE_MAGIC "SSUCRON"
+#define CACHE_VERSION 2
+
+typedef struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;				// 엔트리 수
+	uint32_t sched_count;		// 실행 주기 수
+	uint32_t reserved;
+	uint64_t strtab_size;		// 문자열 테이블 크기
+	uint64_t src_size;			// 원본 파일 크기
+	int64_t src_mtime;			// 원본 파일 수정 시각 (ns)
+	uint64_t src_checksum;		// 원본 파일 내용의 FNV-1a 64 해시
+} cache_header;
+
+typedef struct cache_sched {
+	uint64_t masks[5];			// 분, 시, 일, 월, 요일
+	uint32_t strs[5];			// 분, 시, 일, 월, 요일 문자열의 오프셋
+	uint32_t reserved;
+} cache_sched;
+
+typedef struct cache_entry {
+	uint32_t sched;				// 실행 주기 번호
+	uint32_t op;				// 명령어 문자열의 오프셋
+} cache_entry;
+
+// 캐시를 쓰는 동안 실행 주기 포인터로 번호를 찾는 해시 테이블
+typedef struct sched_index {
+	const schedule **keys;
+	uint32_t *values;
+	size_t size;	// 2의 거듭제곱
+} sched_index;
+
+// 캐시의 문자열 테이블을 만드는 동안 쓰는 버퍼 (같은 문자열은 한 번만 저장)
+typedef struct strtab_builder {
+	char *buf;
+	size_t size;
+	size_t cap;
+	uint32_t *slots;	// 문자열 오프셋 + 1 (0 은 빈 슬롯)
+	size_t nslots;		// 2의 거듭제곱
+	size_t count;
+} strtab_builder;
+
+// 압축하는 동안 새 저널을 쓰는 파일 (ssu_crontab_file 을 바꾼 뒤에 저널로 rename)
+#define CRONTAB_JOURNAL_NEW CRONTAB_JOURNAL ".new"
+
+// 저널 첫 줄 "SSUJ1 크기 수정시각 해시 다음번호 번호..." (번호들은 ssu_crontab_file 의 엔트리 순서)
+typedef struct journal_header {
+	uint64_t size;				// ssu_crontab_file 크기
+	int64_t mtime;				// ssu_crontab_file 수정 시각 (ns)
+	uint64_t checksum;			// ssu_crontab_file 내용의 FNV-1a 64 해시
+	uint32_t next_id;			// 압축할 때의 다음 엔트리 번호
+	const char *ids, *end;		// 엔트리 번호 목록 (첫 줄의 나머지)
+} journal_header;
+
+// 저널을 적용하는 동안 엔트리 번호로 노드를 찾는 해시 테이블 (linear probing)
+typedef struct id_index {
+	crontab **slots;			// 빈 슬롯은 NULL, 지운 슬롯은 deleted
+	crontab *deleted;
+	size_t size;				// 2의 거듭제곱
+} id_index;
+
+// 로그 파일 하나에 대한 링 버퍼
+typedef struct log_writer {
+	char path[BUF_SIZE];
+	int fd;
+	dev_t dev;			// 열어둔 파일 (logrotate 로 바뀌었는지 확인)
+	ino_t ino;
+	char *ring;
+	size_t head;		// 다음에 기록할 위치 (누적값)
+	size_t tail;		// 다음에 파일로 쓸 위치 (누적값)
+	unsigned long dropped;	// 링 버퍼가 가득 차서 버린 로그 수 (아직 알리지 않은 것)
+} log_writer;
+
+static log_writer log_writers[LOG_MAX_FILES];
+static int log_count;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_ready = PTHREAD_COND_INITIALIZER;	// 쓸 로그가 생김
+static pthread_cond_t log_space = PTHREAD_COND_INITIALIZER;	// 링 버퍼에 자리가 생김
+static pid_t log_pid;	// 로그 스레드를 만든 프로세스 (fork 이후에는 새로 만들어야 함)
+
+/**
+  arena 에서 메모리를 할당하는 함수
+  개별 해제는 불가능하며 arena_free 로 한 번에 해제함
+  @param a arena
+  @param size 할당할 크기
+  @return 0 으로 초기화된 메모리
+  */
+void *arena_alloc(arena *a, size_t size) {
+	arena_chunk *chunk = a->chunks;
+	void *p;
+
+	// 포인터 정렬을 맞춤
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		size_t csize = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+
+		chunk = malloc(sizeof(arena_chunk) + csize);
+		chunk->used = 0;
+		chunk->size = csize;
+		chunk->next = a->chunks;
+		a->chunks = chunk;
+	}
+
+	p = chunk->data + chunk->used;
+	chunk->used += size;
+	memset(p, 0, size);
+	return p;
+}
+
+/**
+  문자열을 arena 에 복사하는 함수
+  @param a arena
+  @param str 복사할 문자열 (NULL 로 끝나지 않아도 됨)
+  @param len 복사할 길이
+  @return NULL 로 끝나는 복사본
+  */
+char *arena_strndup(arena *a, const char *str, size_t len) {
+	char *p;
+	arena_chunk *chunk = a->chunks;
+
+	// 문자열은 정렬이 필요 없으므로 남은 자리에 바로 붙임
+	if (chunk != NULL && chunk->size - chunk->used >= len + 1) {
+		p = chunk->data + chunk->used;
+		chunk->used += len + 1;
+	} else
+		p = arena_alloc(a, len + 1);
+
+	memcpy(p, str, len);
+	p[len] = '\0';
+	return p;
+}
+
+/**
+  arena 의 모든 메모리를 해제하는 함수
+  */
+void arena_free(arena *a) {
+	arena_chunk *chunk, *next;
+
+	for (chunk = a->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	a->chunks = NULL;
+}
+
+/**
+  빈 crontab 테이블을 만드는 함수
+  */
+void init_crontab_table(crontab_table *table) {
+	memset(table, 0, sizeof(crontab_table));
+}
+
+/**
+  crontab 테이블의 엔트리와 문자열을 한 번에 해제하는 함수
+  */
+void free_crontab_table(crontab_table *table) {
+	arena_free(&table->arena);
+	free(table->sched_slots);
+	if (table->map != NULL)
+		munmap(table->map, table->map_size);
+	init_crontab_table(table);
+}
+
+/**
+  문자열의 해시값 (FNV-1a)
+  */
+static uint32_t __hash_str(const char *str, size_t len) {
+	uint32_t h = 2166136261u;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char) str[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+  문자열을 intern 테이블에서 찾고, 없으면 arena 에 복사해서 등록하는 함수
+  "*" 처럼 반복되는 주기나 같은 명령어는 메모리를 한 번만 차지함
+  @return arena 에 있는 문자열
+  */
+static const char *__intern(intern_table *it, arena *a, const char *str, size_t len) {
+	size_t slot;
+	const char *s;
+
+	// 절반 이상 차면 두 배로 늘림
+	if (it->count * 2 >= it->size) {
+		intern_table grown;
+
+		grown.size = it->size ? it->size * 2 : 1024;
+		grown.count = it->count;
+		grown.slots = calloc(grown.size, sizeof(char *));
+		for (size_t i = 0; i < it->size; i++) {
+			if ((s = it->slots[i]) == NULL)
+				continue;
+			slot = __hash_str(s, strlen(s)) & (grown.size - 1);
+			while (grown.slots[slot] != NULL)
+				slot = (slot + 1) & (grown.size - 1);
+			grown.slots[slot] = s;
+		}
+		free(it->slots);
+		*it = grown;
+	}
+
+	slot = __hash_str(str, len) & (it->size - 1);
+	while ((s = it->slots[slot]) != NULL) {
+		if (!strncmp(s, str, len) && s[len] == '\0')
+			return s;
+		slot = (slot + 1) & (it->size - 1);
+	}
+
+	it->slots[slot] = arena_strndup(a, str, len);
+	it->count++;
+	return it->slots[slot];
+}
+
+/**
+  다섯 개 주기 문자열의 해시값 (FNV-1a, 필드 경계 포함)
+  */
+static uint32_t __hash_fields(const char *fields[5], const size_t lens[5]) {
+	uint32_t h = 2166136261u;
+
+	for (int i = 0; i < 5; i++) {
+		for (size_t j = 0; j < lens[i]; j++) {
+			h ^= (unsigned char) fields[i][j];
+			h *= 16777619u;
+		}
+		// 필드 경계도 해시에 포함 ("1 23" 과 "12 3" 구분)
+		h ^= ' ';
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+  실행 주기가 주어진 다섯 개 주기 문자열과 같은지 확인하는 함수
+  */
+static int __equal_fields(const schedule *sp, const char *fields[5], const size_t lens[5]) {
+	const char *strs[5] = { sp->min, sp->hour, sp->day, sp->month, sp->dayofweek };
+
+	for (int i = 0; i < 5; i++) {
+		if (strncmp(strs[i], fields[i], lens[i]) || strs[i][lens[i]] != '\0')
+			return 0;
+	}
+	return 1;
+}
+
+/**
+  테이블에서 같은 내용의 실행 주기를 찾고, 없으면 새로 만들어 등록하는 함수
+  @param table 테이블
+  @param it 문자열 intern 테이블 (NULL 이면 문자열을 그냥 복사)
+  @param fields 분, 시, 일, 월, 요일 주기 문자열 (NULL 로 끝나지 않아도 됨)
+  @param lens 각 문자열의 길이
+  @return 테이블의 실행 주기
+  */
+static schedule *__find_schedule(crontab_table *table, intern_table *it, const char *fields[5], const size_t lens[5]) {
+	const char **strs[5];
+	schedule *sp, **slots;
+	size_t size, slot;
+
+	// 절반 이상 차면 두 배로 늘림 (캐시에서 읽은 테이블은 처음 찾을 때 만들어짐)
+	if ((size_t) table->sched_count * 2 >= table->sched_size) {
+		for (size = table->sched_size ? table->sched_size * 2 : 1024; size <= (size_t) table->sched_count * 2; size <<= 1)
+			;
+		slots = calloc(size, sizeof(schedule *));
+		for (sp = table->scheds; sp != NULL; sp = sp->next) {
+			slot = hash_schedule(sp) & (size - 1);
+			while (slots[slot] != NULL)
+				slot = (slot + 1) & (size - 1);
+			slots[slot] = sp;
+		}
+		free(table->sched_slots);
+		table->sched_slots = slots;
+		table->sched_size = size;
+	}
+
+	slot = __hash_fields(fields, lens) & (table->sched_size - 1);
+	while ((sp = table->sched_slots[slot]) != NULL) {
+		if (__equal_fields(sp, fields, lens))
+			return sp;
+		slot = (slot + 1) & (table->sched_size - 1);
+	}
+
+	sp = arena_alloc(&table->arena, sizeof(schedule));
+	strs[0] = &sp->min;
+	strs[1] = &sp->hour;
+	strs[2] = &sp->day;
+	strs[3] = &sp->month;
+	strs[4] = &sp->dayofweek;
+	for (int i = 0; i < 5; i++) {
+		if (it != NULL)
+			*strs[i] = __intern(it, &table->arena, fields[i], lens[i]);
+		else
+			*strs[i] = arena_strndup(&table->arena, fields[i], lens[i]);
+	}
+	sp->next_run = -1;
+	sp->heap_idx = -1;
+
+	sp->next = table->scheds;
+	table->scheds = sp;
+	table->sched_count++;
+	table->sched_slots[slot] = sp;
+	return sp;
+}
+
+/**
+  엔트리를 실행 주기의 엔트리 목록 끝에 추가하는 함수
+  */
+static void __join_schedule(crontab *cp) {
+	schedule *sp = cp->sched;
+
+	cp->group_next = NULL;
+	if (sp->jobs_tail != NULL)
+		sp->jobs_tail->group_next = cp;
+	else
+		sp->jobs = cp;
+	sp->jobs_tail = cp;
+	sp->job_count++;
+}
+
+/**
+  엔트리를 실행 주기의 엔트리 목록에서 빼는 함수
+  엔트리가 없는 실행 주기도 테이블에 남지만 캐시에는 저장되지 않음
+  */
+static void __leave_schedule(crontab *cp) {
+	schedule *sp = cp->sched;
+	crontab **link, *prev = NULL;
+
+	for (link = &sp->jobs; *link != NULL && *link != cp; link = &(*link)->group_next)
+		prev = *link;
+	if (*link == NULL)
+		return;
+
+	*link = cp->group_next;
+	if (sp->jobs_tail == cp)
+		sp->jobs_tail = prev;
+	cp->group_next = NULL;
+	sp->job_count--;
+}
+
+/**
+  명령어에 옵션이 붙어 있으면 파싱해서 노드에 연결하는 함수
+  잘못된 옵션이면 cmd 가 NULL 인 옵션이 연결되어 실행되지 않음
+  */
+static void __attach_opts(crontab_table *table, crontab *cp) {
+	job_opts *opts;
+
+	if (cp->op[0] != '[')
+		return;
+
+	opts = arena_alloc(&table->arena, sizeof(job_opts));
+	if (parse_job_opts(cp->op, opts) < 0)
+		opts->cmd = NULL;
+	cp->opts = opts;
+}
+
+/**
+  테이블의 arena 에 새 노드를 만드는 함수 (리스트에는 추가하지 않음)
+  실행 주기는 테이블에 같은 내용이 있으면 공유하고 없으면 새로 만듦 (컴파일은 하지 않음)
+  @param table 노드를 할당할 테이블
+  @param fields 분, 시, 일, 월, 요일 주기 문자열
+  @param op 명령어
+  @return 새 노드
+  */
+crontab *new_crontab(crontab_table *table, char *fields[5], const char *op) {
+	const char *strs[5];
+	size_t lens[5];
+	crontab *node;
+
+	for (int i = 0; i < 5; i++) {
+		strs[i] = fields[i];
+		lens[i] = strlen(fields[i]);
+	}
+
+	node = arena_alloc(&table->arena, sizeof(crontab));
+	node->sched = __find_schedule(table, NULL, strs, lens);
+	node->op = arena_strndup(&table->arena, op, strlen(op));
+	__attach_opts(table, node);
+	return node;
+}
+
+/**
+  파일 내용의 해시값 (FNV-1a 64)
+  */
+static uint64_t __checksum(const char *p, size_t len) {
+	uint64_t h = 14695981039346656037ull;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char) p[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+/**
+  파일 전체의 해시값을 계산하는 함수
+  @param fd 파일 디스크립터
+  @param size 파일 크기
+  @param sum 해시값을 저장
+  @return 성공 시 0, 에러 시 -1
+  */
+static int __checksum_file(int fd, size_t size, uint64_t *sum) {
+	void *map;
+
+	if (size == 0) {
+		*sum = __checksum(NULL, 0);
+		return 0;
+	}
+
+	if ((map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		return -1;
+	*sum = __checksum(map, size);
+	munmap(map, size);
+	return 0;
+}
 
 /**
-  ssu_crontab_file 을 읽는 함수
+  컴파일된 캐시에서 crontab 테이블을 만드는 함수
+  캐시를 한 번 mmap 하고 문자열은 매핑을 그대로 가리키므로 파싱이나 컴파일을 하지 않음
+  원본의 크기와 수정 시각이 같으면 바로 사용하고, 수정 시각만 다르면 내용 해시로 확인함
+  @param table 빈 테이블
+  @param fd 원본 파일 디스크립터
+  @param src 원본 파일 stat
+  @return 성공 시 0, 캐시가 없거나 오래된 경우 -1
+  */
+static int __load_crontab_cache(crontab_table *table, int fd, const struct stat *src) {
+	struct stat statbuf;
+	const cache_header *hdr;
+	const cache_sched *cs;
+	const cache_entry *ent;
+	const char *strtab;
+	schedule *scheds;
+	crontab *nodes, *tail;
+	uint64_t sum;
+	void *map;
+	int cfd;
+
+	if ((cfd = open(CRONTAB_CACHE, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	if (fstat(cfd, &statbuf) < 0 || (size_t) statbuf.st_size < sizeof(cache_header)) {
+		close(cfd);
+		return -1;
+	}
+
+	map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+	close(cfd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = map;
+	cs = (const cache_sched *) (hdr + 1);
+	ent = (const cache_entry *) (cs + hdr->sched_count);
+	strtab = (const char *) (ent + hdr->count);
+
+	// 형식 확인
+	if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) || hdr->version != CACHE_VERSION ||
+			sizeof(cache_header) + (uint64_t) hdr->sched_count * sizeof(cache_sched) +
+			(uint64_t) hdr->count * sizeof(cache_entry) + hdr->strtab_size != (uint64_t) statbuf.st_size ||
+			hdr->strtab_size == 0 || strtab[hdr->strtab_size - 1] != '\0')
+		goto stale;
+
+	// 원본이 바뀌었는지 확인
+	if (hdr->src_size != (uint64_t) src->st_size)
+		goto stale;
+	if (hdr->src_mtime != (int64_t) src->st_mtim.tv_sec * 1000000000 + src->st_mtim.tv_nsec) {
+		if (__checksum_file(fd, src->st_size, &sum) < 0 || sum != hdr->src_checksum)
+			goto stale;
+	}
+
+	scheds = arena_alloc(&table->arena, hdr->sched_count * sizeof(schedule));
+	for (uint32_t i = 0; i < hdr->sched_count; i++) {
+		const char **strs[5] = { &scheds[i].min, &scheds[i].hour, &scheds[i].day,
+			&scheds[i].month, &scheds[i].dayofweek };
+
+		for (int j = 0; j < 5; j++) {
+			if (cs[i].strs[j] >= hdr->strtab_size)
+				goto stale;
+			*strs[j] = strtab + cs[i].strs[j];
+		}
+		scheds[i].min_mask = cs[i].masks[0];
+		scheds[i].hour_mask = cs[i].masks[1];
+		scheds[i].day_mask = cs[i].masks[2];
+		scheds[i].month_mask = cs[i].masks[3];
+		scheds[i].dow_mask = cs[i].masks[4];
+		scheds[i].next_run = -1;
+		scheds[i].heap_idx = -1;
+		scheds[i].next = i + 1 < hdr->sched_count ? &scheds[i + 1] : NULL;
+	}
+
+	nodes = arena_alloc(&table->arena, hdr->count * sizeof(crontab));
+	tail = &table->head;
+	for (uint32_t i = 0; i < hdr->count; i++) {
+		if (ent[i].sched >= hdr->sched_count || ent[i].op >= hdr->strtab_size)
+			goto stale;
+		nodes[i].sched = &scheds[ent[i].sched];
+		nodes[i].op = strtab + ent[i].op;
+		__attach_opts(table, &nodes[i]);
+		__join_schedule(&nodes[i]);
+
+		tail->next = &nodes[i];
+		nodes[i].prev = tail;
+		tail = &nodes[i];
+	}
+	tail->next = NULL;
+
+	table->scheds = hdr->sched_count ? scheds : NULL;
+	table->sched_count = hdr->sched_count;
+	table->count = hdr->count;
+	table->map = map;
+	table->map_size = statbuf.st_size;
+	return 0;
+
+stale:
+	munmap(map, statbuf.st_size);
+	arena_free(&table->arena);
+	table->head.next = NULL;
+	return -1;
+}
+
+/**
+  실행 주기 포인터에 번호를 붙이는 함수
+  */
+static void __sched_index_put(sched_index *idx, const schedule *sp, uint32_t value) {
+	size_t slot = ((uintptr_t) sp >> 4) * 2654435761u & (idx->size - 1);
+
+	while (idx->keys[slot] != NULL)
+		slot = (slot + 1) & (idx->size - 1);
+	idx->keys[slot] = sp;
+	idx->values[slot] = value;
+}
+
+/**
+  실행 주기 포인터의 번호를 찾는 함수 (반드시 등록되어 있어야 함)
+  */
+static uint32_t __sched_index_get(const sched_index *idx, const schedule *sp) {
+	size_t slot = ((uintptr_t) sp >> 4) * 2654435761u & (idx->size - 1);
+
+	while (idx->keys[slot] != sp)
+		slot = (slot + 1) & (idx->size - 1);
+	return idx->values[slot];
+}
+
+/**
+  캐시 문자열 테이블에 문자열을 넣는 함수
+  @return 문자열의 오프셋
+  */
+static uint32_t __strtab_add(strtab_builder *b, const char *str) {
+	size_t len = strlen(str), slot;
+	uint32_t off;
+
+	// 절반 이상 차면 슬롯을 두 배로 늘림
+	if (b->count * 2 >= b->nslots) {
+		size_t nslots = b->nslots ? b->nslots * 2 : 1024;
+		uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+
+		for (size_t i = 0; i < b->nslots; i++) {
+			if ((off = b->slots[i]) == 0)
+				continue;
+			slot = __hash_str(b->buf + off - 1, strlen(b->buf + off - 1)) & (nslots - 1);
+			while (slots[slot] != 0)
+				slot = (slot + 1) & (nslots - 1);
+			slots[slot] = off;
+		}
+		free(b->slots);
+		b->slots = slots;
+		b->nslots = nslots;
+	}
 
-  @param head 파싱된 데이터를 링크드 리스트 형태로 넣어줌
+	slot = __hash_str(str, len) & (b->nslots - 1);
+	while ((off = b->slots[slot]) != 0) {
+		if (!strcmp(b->buf + off - 1, str))
+			return off - 1;
+		slot = (slot + 1) & (b->nslots - 1);
+	}
+
+	while (b->size + len + 1 > b->cap) {
+		b->cap = b->cap ? b->cap * 2 : 4096;
+		b->buf = realloc(b->buf, b->cap);
+	}
+	memcpy(b->buf + b->size, str, len + 1);
+	b->slots[slot] = b->size + 1;
+	b->count++;
+	b->size += len + 1;
+	return b->size - len - 1;
+}
+
+/**
+  crontab 테이블을 컴파일된 캐시 파일로 저장하는 함수
+  현재 ssu_crontab_file 의 내용과 테이블이 같아야 함
+  임시 파일에 쓴 뒤 rename 하므로 캐시를 읽고 있는 다른 프로세스에 영향이 없음
+  @param table 저장할 테이블 (컴파일 되어 있어야 함)
   @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
   */
-int read_crontab_file(crontab *head) {
-	FILE *fp;
-	crontab *node, *tail;
+int write_crontab_cache(const crontab_table *table) {
+	struct stat statbuf;
+	cache_header hdr;
+	cache_sched *scheds;
+	cache_entry *ents;
+	sched_index idx;
+	strtab_builder b;
+	const schedule *sp;
+	const crontab *ct;
+	char tmpname[BUF_SIZE];
+	uint32_t count = 0, nsched = 0;
+	int fd, ret = -1;
 
-	if (head == NULL) {
-		sprintf(err_str, "head is NULL\n");
+	if ((fd = open(CRONTAB_FILE, O_RDONLY | O_CLOEXEC)) < 0) {
+		sprintf(err_str, "[write_crontab_cache] %s open error\n", CRONTAB_FILE);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	hdr.version = CACHE_VERSION;
+	if (fstat(fd, &statbuf) < 0 || __checksum_file(fd, statbuf.st_size, &hdr.src_checksum) < 0) {
+		close(fd);
+		sprintf(err_str, "[write_crontab_cache] %s read error\n", CRONTAB_FILE);
+		return -1;
+	}
+	close(fd);
+	hdr.src_size = statbuf.st_size;
+	hdr.src_mtime = (int64_t) statbuf.st_mtim.tv_sec * 1000000000 + statbuf.st_mtim.tv_nsec;
+
+	for (ct = table->head.next; ct != NULL; ct = ct->next)
+		count++;
+	hdr.count = count;
+
+	memset(&b, 0, sizeof(b));
+	for (idx.size = 16; idx.size <= (size_t) table->sched_count * 2; idx.size <<= 1)
+		;
+	idx.keys = calloc(idx.size, sizeof(schedule *));
+	idx.values = malloc(idx.size * sizeof(uint32_t));
+	scheds = malloc(table->sched_count * sizeof(cache_sched) + 1);
+	ents = malloc(count * sizeof(cache_entry) + 1);
+
+	// 엔트리가 남아있는 실행 주기만 저장
+	for (sp = table->scheds; sp != NULL; sp = sp->next) {
+		if (sp->job_count == 0)
+			continue;
+
+		memset(&scheds[nsched], 0, sizeof(cache_sched));
+		scheds[nsched].masks[0] = sp->min_mask;
+		scheds[nsched].masks[1] = sp->hour_mask;
+		scheds[nsched].masks[2] = sp->day_mask;
+		scheds[nsched].masks[3] = sp->month_mask;
+		scheds[nsched].masks[4] = sp->dow_mask;
+		scheds[nsched].strs[0] = __strtab_add(&b, sp->min);
+		scheds[nsched].strs[1] = __strtab_add(&b, sp->hour);
+		scheds[nsched].strs[2] = __strtab_add(&b, sp->day);
+		scheds[nsched].strs[3] = __strtab_add(&b, sp->month);
+		scheds[nsched].strs[4] = __strtab_add(&b, sp->dayofweek);
+		__sched_index_put(&idx, sp, nsched++);
+	}
+	hdr.sched_count = nsched;
+
+	count = 0;
+	for (ct = table->head.next; ct != NULL; ct = ct->next, count++) {
+		ents[count].sched = __sched_index_get(&idx, ct->sched);
+		ents[count].op = __strtab_add(&b, ct->op);
+	}
+
+	// 문자열 테이블은 비어있지 않고 항상 NULL 로 끝나야 함
+	if (b.size == 0)
+		__strtab_add(&b, "");
+	hdr.strtab_size = b.size;
+
+	sprintf(tmpname, "%s.XXXXXX", CRONTAB_CACHE);
+	if ((fd = mkstemp(tmpname)) < 0) {
+		sprintf(err_str, "[write_crontab_cache] mkstemp error\n");
+		goto out;
+	}
+	fchmod(fd, 0644);
+
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+			write(fd, scheds, nsched * sizeof(cache_sched)) != (ssize_t) (nsched * sizeof(cache_sched)) ||
+			write(fd, ents, count * sizeof(cache_entry)) != (ssize_t) (count * sizeof(cache_entry)) ||
+			write(fd, b.buf, b.size) != (ssize_t) b.size ||
+			close(fd) < 0 || rename(tmpname, CRONTAB_CACHE) < 0) {
+		sprintf(err_str, "[write_crontab_cache] write error for %s\n", CRONTAB_CACHE);
+		unlink(tmpname);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	free(b.slots);
+	free(b.buf);
+	free(idx.keys);
+	free(idx.values);
+	free(scheds);
+	free(ents);
+	return ret;
+}
+
+static int __read_snapshot(crontab_table *table, struct stat *statbuf);
+static int __apply_journal(crontab_table *table, const struct stat *src);
+
+/**
+  ssu_crontab_file 과 저널을 읽는 함수
+  컴파일된 캐시가 유효하면 캐시를 바로 쓰고, 없거나 오래되었으면 파일을 파싱한 뒤 캐시를 다시 만듦
+  저널의 추가, 삭제 기록은 그 위에 적용함
+  읽는 동안 압축이 끼어들지 않도록 lock_crontab(F_RDLCK) 이상을 잡은 채로 불러야 함
+
+  @param table 파싱된 데이터를 링크드 리스트 형태로 넣어줌 (init_crontab_table 로 초기화 되어 있어야 함)
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+int read_crontab_file(crontab_table *table) {
+	struct stat statbuf;
+	schedule *sp, *last;
+	int fd, ret;
+
+	if (table == NULL) {
+		sprintf(err_str, "table is NULL\n");
+		return -1;
+	}
+
+	if ((fd = open(CRONTAB_FILE, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &statbuf) < 0) {
+		if (fd >= 0)
+			close(fd);
+		sprintf(err_str, "[read_crontab_file] %s fopen error\n", CRONTAB_FILE);
+		return -1;
+	}
+	ret = __load_crontab_cache(table, fd, &statbuf);
+	close(fd);
+
+	if (ret < 0) {
+		if (__read_snapshot(table, &statbuf) < 0)
+			return -1;
+
+		// 실행 주기는 로드 시 서로 다른 주기마다 한 번만 파싱해서 비트마스크로 저장
+		for (sp = table->scheds; sp != NULL; sp = sp->next)
+			compile_schedule(sp);
+
+		// 캐시는 ssu_crontab_file 만 담음
+		// 캐시를 만들지 못해도 (쓰기 권한 등) 읽기는 성공
+		write_crontab_cache(table);
+	}
+
+	// 저널로 새로 생긴 주기만 컴파일 (새 주기는 리스트 앞에 붙음)
+	last = table->scheds;
+	if (__apply_journal(table, &statbuf) < 0)
 		return -1;
+	for (sp = table->scheds; sp != last; sp = sp->next)
+		compile_schedule(sp);
+	return 0;
+}
+
+/**
+  crontab 파일의 한 줄을 실행 주기 필드 5개와 명령어로 나누는 함수
+  필드 사이는 공백이나 탭이며, 명령어는 앞의 공백과 끝의 \r 을 뺀 나머지 전부
+  @param p 줄 시작
+  @param eol 줄 끝 (개행 문자 위치 또는 파일 끝)
+  @param fields 분, 시, 일, 월, 요일 필드 시작 위치 저장
+  @param lens 필드 길이 저장
+  @param op 명령어 시작 위치 저장
+  @return 명령어 길이, 필드가 모자란 줄 (빈 줄 등) 이면 -1
+  */
+long split_crontab_line(const char *p, const char *eol, const char *fields[5], size_t lens[5], const char **op) {
+	const char *tok;
+
+	for (int n = 0; n < 5; n++) {
+		while (p < eol && (*p == ' ' || *p == '\t'))
+			p++;
+		for (tok = p; p < eol && *p != ' ' && *p != '\t'; p++)
+			;
+		if (p == tok)
+			return -1;
+		fields[n] = tok;
+		lens[n] = p - tok;
 	}
 
-	tail = head;
+	while (p < eol && (*p == ' ' || *p == '\t'))
+		p++;
+	*op = p;
+	if (eol > p && eol[-1] == '\r')
+		eol--;
+	return eol - p;
+}
+
+/**
+  ssu_crontab_file 만 읽고 저널은 적용하지 않는 함수 (실행 주기도 컴파일하지 않음)
+  파일을 mmap 해서 한 번 훑으며 노드와 문자열을 테이블의 arena 에 만들고,
+  같은 실행 주기를 가진 줄들은 하나의 schedule 을 공유함
+  @param table 빈 테이블
+  @param statbuf 읽은 ssu_crontab_file 의 stat 저장
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __read_snapshot(crontab_table *table, struct stat *statbuf) {
+	intern_table it;
+	crontab *node, *tail;
+	const char *map, *p, *end, *eol, *tok;
+	const char *fields[5];
+	size_t lens[5];
+	long oplen;
+	int fd;
 
-	if ((fp = fopen(CRONTAB_FILE, "r")) == NULL) {
+	if ((fd = open(CRONTAB_FILE, O_RDONLY)) < 0 || fstat(fd, statbuf) < 0) {
+		if (fd >= 0)
+			close(fd);
 		sprintf(err_str, "[read_crontab_file] %s fopen error\n", CRONTAB_FILE);
 		return -1;
 	}
 
-	while (!feof(fp)) {
-		node = calloc(1, sizeof(crontab));
-		if (fscanf(fp, "%s", node->min) < 0)
-			break;
-		fscanf(fp, "%s", node->hour);
-		fscanf(fp, "%s", node->day);
-		fscanf(fp, "%s", node->month);
-		fscanf(fp, "%s", node->dayofweek);
+	tail = &table->head;
+	tail->next = NULL;
+
+	if (statbuf->st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, statbuf->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		sprintf(err_str, "[read_crontab_file] %s mmap error\n", CRONTAB_FILE);
+		return -1;
+	}
+	madvise((void *) map, statbuf->st_size, MADV_SEQUENTIAL);
+
+	memset(&it, 0, sizeof(it));
+	end = map + statbuf->st_size;
+	for (p = map; p < end; p = eol + 1) {
+		if ((eol = memchr(p, '\n', end - p)) == NULL)
+			eol = end;
+
+		// 필드가 모자란 줄 (빈 줄 등) 은 무시
+		if ((oplen = split_crontab_line(p, eol, fields, lens, &tok)) < 0)
+			continue;
+
+		node = arena_alloc(&table->arena, sizeof(crontab));
+		node->sched = __find_schedule(table, &it, fields, lens);
+		node->op = __intern(&it, &table->arena, tok, oplen);
+		__attach_opts(table, node);
+		__join_schedule(node);
 
-		fgets(node->op, sizeof(node->op), fp);
-		node->op[strlen(node->op) - 1] = '\0';
 		tail->next = node;
 		node->prev = tail;
 		tail = node;
+		table->count++;
+	}
+
+	munmap((void *) map, statbuf->st_size);
+	free(it.slots);
+	return 0;
+}
+
+/**
+  저널 기록 한 줄의 숫자 하나를 읽는 함수
+  @param p 읽을 위치 (앞의 공백은 건너뜀)
+  @param eol 줄 끝
+  @param v 읽은 값 저장
+  @param base 10 또는 16
+  @return 숫자 다음 위치, 숫자가 없으면 NULL
+  */
+static const char *__journal_num(const char *p, const char *eol, uint64_t *v, int base) {
+	const char *start;
+	int d;
+
+	while (p < eol && *p == ' ')
+		p++;
+	*v = 0;
+	for (start = p; p < eol; p++) {
+		if (*p >= '0' && *p <= '9')
+			d = *p - '0';
+		else if (base == 16 && *p >= 'a' && *p <= 'f')
+			d = *p - 'a' + 10;
+		else
+			break;
+		*v = *v * base + d;
 	}
+	return p > start ? p : NULL;
+}
 
+/**
+  저널 첫 줄을 읽는 함수
+  @param p 첫 줄 시작
+  @param eol 첫 줄 끝
+  @param hdr 결과 저장
+  @return 성공 시 0, 형식이 맞지 않으면 -1
+  */
+static int __journal_header(const char *p, const char *eol, journal_header *hdr) {
+	uint64_t v[4];
+	size_t n = strlen(JOURNAL_MAGIC);
+
+	if (eol - p < (long) n || memcmp(p, JOURNAL_MAGIC, n) != 0)
+		return -1;
+	p += n;
+
+	for (int i = 0; i < 4; i++) {
+		if ((p = __journal_num(p, eol, &v[i], i == 2 ? 16 : 10)) == NULL)
+			return -1;
+	}
+	hdr->size = v[0];
+	hdr->mtime = v[1];
+	hdr->checksum = v[2];
+	hdr->next_id = v[3];
+	hdr->ids = p;
+	hdr->end = eol;
 	return 0;
 }
 
 /**
-  crontab 노드를 리스트에 추가하는 함수
-  @param head 원본 리스트
-  @param cp 추가할 노드
-  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  저널 첫 줄이 지금의 ssu_crontab_file 에 대한 것인지 확인하는 함수
+  크기와 수정 시각이 같으면 바로 맞다고 보고, 수정 시각만 다르면 내용 해시로 확인함
+  */
+static int __journal_matches(const journal_header *hdr, const struct stat *src) {
+	uint64_t sum;
+	int fd, ret;
+
+	if (hdr->size != (uint64_t) src->st_size)
+		return 0;
+	if (hdr->mtime == (int64_t) src->st_mtim.tv_sec * 1000000000 + src->st_mtim.tv_nsec)
+		return 1;
+
+	if ((fd = open(CRONTAB_FILE, O_RDONLY | O_CLOEXEC)) < 0)
+		return 0;
+	ret = __checksum_file(fd, src->st_size, &sum) == 0 && sum == hdr->checksum;
+	close(fd);
+	return ret;
+}
+
+/**
+  파일 전체를 읽는 함수 (NULL 로 끝남)
+  @param path 파일 경로
+  @param len 파일 길이 저장
+  @return 새로 할당한 내용, 에러 시 NULL (errno 유지)
+  */
+static char *__read_whole(const char *path, size_t *len) {
+	struct stat statbuf;
+	char *buf;
+	ssize_t n;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return NULL;
+	if (fstat(fd, &statbuf) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	buf = malloc(statbuf.st_size + 1);
+	for (*len = 0; *len < (size_t) statbuf.st_size; *len += n) {
+		if ((n = read(fd, buf + *len, statbuf.st_size - *len)) <= 0)
+			break;
+	}
+	close(fd);
+	buf[*len] = '\0';
+	return buf;
+}
+
+/**
+  노드를 엔트리 번호 해시 테이블에 넣는 함수
+  */
+static void __id_put(id_index *idx, crontab *ct) {
+	size_t slot = ct->id * 2654435761u & (idx->size - 1);
+
+	while (idx->slots[slot] != NULL && idx->slots[slot] != idx->deleted)
+		slot = (slot + 1) & (idx->size - 1);
+	idx->slots[slot] = ct;
+}
+
+/**
+  엔트리 번호로 해시 테이블의 슬롯을 찾는 함수
+  @return 노드가 들어있는 슬롯, 없으면 NULL
+  */
+static crontab **__id_slot(id_index *idx, uint32_t id) {
+	size_t slot = id * 2654435761u & (idx->size - 1);
+
+	for (; idx->slots[slot] != NULL; slot = (slot + 1) & (idx->size - 1)) {
+		if (idx->slots[slot] != idx->deleted && idx->slots[slot]->id == id)
+			return &idx->slots[slot];
+	}
+	return NULL;
+}
+
+/**
+  리스트에서 내용이 같은 첫 엔트리를 찾는 함수
+  필드 사이의 공백 수나 줄 끝의 \r 은 달라도 같은 엔트리로 봄
+  @param head 리스트 헤드
+  @param p "분 시 일 월 요일 명령어" 줄 시작
+  @param eol 줄 끝
+  @return 찾은 노드, 없으면 NULL
+  */
+static crontab *__find_line(crontab *head, const char *p, const char *eol) {
+	const char *fields[5], *op;
+	size_t lens[5];
+	crontab *ct;
+	long oplen;
+
+	if ((oplen = split_crontab_line(p, eol, fields, lens, &op)) < 0)
+		return NULL;
+
+	for (ct = head->next; ct != NULL; ct = ct->next) {
+		const char *strs[5] = { ct->sched->min, ct->sched->hour, ct->sched->day, ct->sched->month, ct->sched->dayofweek };
+		int same = strlen(ct->op) == (size_t) oplen && !memcmp(ct->op, op, oplen);
+
+		for (int i = 0; i < 5 && same; i++)
+			same = strlen(strs[i]) == lens[i] && !memcmp(strs[i], fields[i], lens[i]);
+		if (same)
+			return ct;
+	}
+	return NULL;
+}
+
+/**
+  저널을 읽어서 ssu_crontab_file 로 만든 테이블에 엔트리 번호를 붙이고 추가, 삭제 기록을 적용하는 함수
+  저널 첫 줄이 지금의 ssu_crontab_file 에 대한 것이면 파일의 엔트리는 첫 줄에 적힌 번호를 쓰고,
+  파일을 손으로 고쳐서 달라졌으면 새 번호를 붙이고 삭제 기록은 번호 대신 내용으로 찾음 (journal_stale)
+  압축하다 멈춰서 ssu_crontab_file 만 바뀌어 있으면 새로 써둔 저널로 마저 바꿈
+  끝에 개행이 없는 줄은 쓰다 만 기록이므로 무시함
+  @param table ssu_crontab_file 을 읽은 테이블
+  @param src ssu_crontab_file stat
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __apply_journal(crontab_table *table, const struct stat *src) {
+	journal_header hdr, nhdr;
+	id_index idx;
+	crontab *ct, *tail, **slot;
+	char *buf, *nbuf;
+	const char *p, *eol, *end, *line, *ids;
+	size_t len, nlen, records = 0;
+	uint64_t v;
+	uint32_t id, max = 0;
+	int type, match, have;
+
+	table->journal_len = 0;
+	table->journal_stale = 0;
+	if ((buf = __read_whole(CRONTAB_JOURNAL, &len)) == NULL) {
+		if (errno != ENOENT) {
+			sprintf(err_str, "[read_crontab_file] %s read error\n", CRONTAB_JOURNAL);
+			return -1;
+		}
+
+		// 저널이 없으면 파일 순서대로 번호를 붙임
+		id = 1;
+		for (ct = table->head.next; ct != NULL; ct = ct->next)
+			ct->id = id++;
+		table->next_id = id;
+		return 0;
+	}
+
+	end = buf + len;
+	eol = memchr(buf, '\n', len);
+	have = eol != NULL && __journal_header(buf, eol, &hdr) == 0;
+	match = have && __journal_matches(&hdr, src);
+
+	if (!match && (nbuf = __read_whole(CRONTAB_JOURNAL_NEW, &nlen)) != NULL) {
+		const char *neol = memchr(nbuf, '\n', nlen);
+
+		if (neol != NULL && __journal_header(nbuf, neol, &nhdr) == 0 && __journal_matches(&nhdr, src)
+				&& (rename(CRONTAB_JOURNAL_NEW, CRONTAB_JOURNAL) == 0 || errno == ENOENT)) {
+			// 다른 읽는 프로세스가 먼저 바꿨어도 (ENOENT) 읽은 내용은 지금의 저널과 같음
+			free(buf);
+			buf = nbuf;
+			len = nlen;
+			end = buf + len;
+			eol = neol;
+			hdr = nhdr;
+			have = match = 1;
+		} else
+			free(nbuf);
+	}
+
+	// 기록 수와 가장 큰 번호 (첫 줄이 없는 저널은 기록도 없는 것으로 봄)
+	p = have ? eol + 1 : end;
+	for (const char *q = p, *qe; q < end && (qe = memchr(q, '\n', end - q)) != NULL; q = qe + 1) {
+		if (parse_journal_record(q, qe, &id, &line) > 0 && id > max)
+			max = id;
+		records++;
+	}
+
+	// 첫 줄의 번호를 파일의 엔트리 순서대로 붙임, 수가 맞지 않으면 손으로 고친 것으로 봄
+	if (match) {
+		ids = hdr.ids;
+		for (ct = table->head.next; ct != NULL && match; ct = ct->next) {
+			if ((ids = __journal_num(ids, hdr.end, &v, 10)) == NULL)
+				match = 0;
+			else
+				ct->id = v;
+		}
+		if (match && __journal_num(ids, hdr.end, &v, 10) != NULL)
+			match = 0;
+	}
+
+	// 손으로 고친 파일의 엔트리는 저널의 어떤 번호와도 겹치지 않는 새 번호를 받음
+	id = have && hdr.next_id > max ? hdr.next_id : max + 1;
+	if (!match) {
+		table->journal_stale = 1;
+		for (ct = table->head.next; ct != NULL; ct = ct->next)
+			ct->id = id++;
+	}
+	table->next_id = id;
+
+	for (idx.size = 16; idx.size <= ((size_t) table->count + records) * 2; idx.size <<= 1)
+		;
+	idx.slots = calloc(idx.size, sizeof(crontab *));
+	idx.deleted = &table->head;
+	for (tail = &table->head; tail->next != NULL; tail = tail->next)
+		__id_put(&idx, tail->next);
+
+	for (; p < end && (eol = memchr(p, '\n', end - p)) != NULL; p = eol + 1) {
+		if ((type = parse_journal_record(p, eol, &id, &line)) == JOURNAL_ADD) {
+			if ((ct = new_crontab_line(table, line, eol - line)) == NULL)
+				continue;
+			ct->id = id;
+			ct->prev = tail;
+			tail->next = ct;
+			tail = ct;
+			__join_schedule(ct);
+			__id_put(&idx, ct);
+			table->count++;
+			if (id >= table->next_id)
+				table->next_id = id + 1;
+		} else if (type == JOURNAL_REMOVE) {
+			// 파일의 엔트리 번호를 모르면 내용으로 찾음 (이미 지운 번호는 무시)
+			if ((slot = __id_slot(&idx, id)) != NULL)
+				ct = *slot;
+			else if (!match && (ct = __find_line(&table->head, line, eol)) != NULL)
+				slot = __id_slot(&idx, ct->id);
+			else
+				continue;
+
+			if (slot != NULL)
+				*slot = idx.deleted;
+			if (ct == tail)
+				tail = ct->prev;
+			remove_crontab(ct);
+			table->count--;
+		}
+	}
+
+	table->journal_len = p - buf;
+	free(idx.slots);
+	free(buf);
+	return 0;
+}
+
+/**
+  ssu_crontab_file 과 저널을 읽기만 하고 실행 주기는 컴파일하지 않는 함수
+  바뀐 주기만 컴파일 하려는 경우 사용 (compile_schedule 을 직접 호출해야 함)
+  read_crontab_file 과 같이 lock_crontab 을 잡은 채로 불러야 함
+
+  @param table 파싱된 데이터를 링크드 리스트 형태로 넣어줌 (init_crontab_table 로 초기화 되어 있어야 함)
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+int read_crontab_file_raw(crontab_table *table) {
+	struct stat statbuf;
+
+	if (table == NULL) {
+		sprintf(err_str, "table is NULL\n");
+		return -1;
+	}
+
+	if (__read_snapshot(table, &statbuf) < 0)
+		return -1;
+	return __apply_journal(table, &statbuf);
+}
+
+/**
+  "분 시 일 월 요일 명령어" 한 줄로 테이블의 arena 에 새 노드를 만드는 함수 (리스트에는 추가하지 않음)
+  new_crontab 과 같이 실행 주기는 공유하고 컴파일하지 않으며, 엔트리 번호는 호출한 쪽에서 붙임
+  @param table 노드를 할당할 테이블
+  @param line 줄 시작 (NULL 로 끝나지 않아도 됨)
+  @param len 줄 길이
+  @return 새 노드, 필드가 모자란 줄이면 NULL
+  */
+crontab *new_crontab_line(crontab_table *table, const char *line, size_t len) {
+	const char *fields[5], *op;
+	size_t lens[5];
+	crontab *node;
+	long oplen;
+
+	if ((oplen = split_crontab_line(line, line + len, fields, lens, &op)) < 0)
+		return NULL;
+
+	node = arena_alloc(&table->arena, sizeof(crontab));
+	node->sched = __find_schedule(table, NULL, fields, lens);
+	node->op = arena_strndup(&table->arena, op, oplen);
+	__attach_opts(table, node);
+	return node;
+}
+
+/**
+  리스트에서 엔트리를 찾는 함수
+  @param head 리스트 헤드
+  @param id 엔트리 번호 (0 이면 번호로 찾지 않음)
+  @param line 번호로 찾지 못했을 때 내용으로 찾을 "분 시 일 월 요일 명령어" (NULL 이면 내용으로 찾지 않음)
+  @return 찾은 노드, 없으면 NULL
+  */
+crontab *find_crontab(crontab *head, uint32_t id, const char *line) {
+	crontab *ct;
+
+	if (id != 0) {
+		for (ct = head->next; ct != NULL; ct = ct->next) {
+			if (ct->id == id)
+				return ct;
+		}
+	}
+	return line != NULL ? __find_line(head, line, line + strlen(line)) : NULL;
+}
+
+/**
+  저널 기록 한 줄을 읽는 함수 ("+번호 분 시 일 월 요일 명령어" 또는 "-번호 분 시 일 월 요일 명령어")
+  @param p 줄 시작
+  @param eol 줄 끝 (개행 문자 위치)
+  @param id 엔트리 번호 저장
+  @param line "분 시 일 월 요일 명령어" 시작 위치 저장 (eol 까지)
+  @return JOURNAL_ADD 또는 JOURNAL_REMOVE, 형식이 맞지 않으면 -1
+  */
+int parse_journal_record(const char *p, const char *eol, uint32_t *id, const char **line) {
+	uint64_t v;
+	int type;
+
+	if (p >= eol || (*p != JOURNAL_ADD && *p != JOURNAL_REMOVE))
+		return -1;
+	type = *p++;
+
+	if (p >= eol || *p == ' ' || (p = __journal_num(p, eol, &v, 10)) == NULL || v == 0 || v > UINT32_MAX
+			|| p >= eol || *p != ' ')
+		return -1;
+	*id = v;
+	*line = p + 1;
+	return type;
+}
+
+/**
+  저널 끝에 기록 한 줄을 붙이는 함수
+  한 번의 write 로 붙이므로 여러 프로세스가 동시에 붙여도 줄이 섞이지 않고,
+  쓰다가 멈춰서 개행 없이 남은 줄은 읽을 때 무시됨
+  붙이기 전에 테이블이 최신인지 확인할 수 있도록 lock_crontab(F_WRLCK) 을 잡은 채로 불러야 함
+  @param type JOURNAL_ADD 또는 JOURNAL_REMOVE
+  @param id 엔트리 번호
+  @param line "분 시 일 월 요일 명령어"
+  @param end 붙인 뒤의 저널 길이 저장
+  @return 붙인 길이, 저널이 없으면 0 (compact_crontab 으로 만들어야 함), 에러 시 -1 리턴하고 err_str 설정
+  */
+ssize_t append_crontab_journal(int type, uint32_t id, const char *line, off_t *end) {
+	char *buf;
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(CRONTAB_JOURNAL, O_WRONLY | O_APPEND | O_CLOEXEC)) < 0) {
+		if (errno == ENOENT)
+			return 0;
+		sprintf(err_str, "[journal] open error for %s\n", CRONTAB_JOURNAL);
+		return -1;
+	}
+
+	len = snprintf(NULL, 0, "%c%u %s\n", type, id, line);
+	buf = malloc(len + 1);
+	sprintf(buf, "%c%u %s\n", type, id, line);
+	if (write(fd, buf, len) != len || (*end = lseek(fd, 0, SEEK_CUR)) < 0) {
+		sprintf(err_str, "[journal] write error for %s\n", CRONTAB_JOURNAL);
+		len = -1;
+	}
+
+	free(buf);
+	close(fd);
+	return len;
+}
+
+/**
+  파일이 들어있는 디렉토리를 fsync 하는 함수 (rename 을 디스크에 남김)
+  @param path 파일 경로
+  @return 성공 시 0, 에러 시 -1
+  */
+static int __sync_dir(const char *path) {
+	char dir[PATH_MAX];
+	const char *slash;
+	int fd, ret;
+
+	if ((slash = strrchr(path, '/')) == NULL)
+		strcpy(dir, ".");
+	else if (slash == path)
+		strcpy(dir, "/");
+	else
+		snprintf(dir, sizeof(dir), "%.*s", (int) (slash - path), path);
+
+	if ((fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+		return -1;
+	ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+/**
+  테이블을 새 ssu_crontab_file 로 쓰고 저널을 비우는 함수 (압축)
+  새 파일과 그 파일에 대한 빈 저널을 임시 파일로 모두 쓰고 fsync 한 뒤 ssu_crontab_file, 저널 순서로 rename 하므로
+  어느 순간에 멈춰도 예전 파일과 저널, 또는 새 파일과 CRONTAB_JOURNAL_NEW 가 남고 뒤의 경우는 읽을 때 마저 바꿈
+  엔트리 번호는 그대로 저널 첫 줄에 남으므로 압축해도 바뀌지 않음
+  압축하는 동안 읽거나 붙이지 못하도록 lock_crontab(F_WRLCK) 을 잡은 채로 불러야 함
+  @param table 지금의 ssu_crontab_file 과 저널을 적용한 내용의 테이블 (컴파일 되어 있어야 함, 캐시도 새로 씀)
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+int compact_crontab(const crontab_table *table) {
+	struct stat statbuf;
+	const crontab *ct;
+	const schedule *sp;
+	char tmpname[sizeof(CRONTAB_FILE ".XXXXXX")], *buf = NULL;
+	size_t len = 0, cap = 0;
+	uint64_t sum;
+	FILE *fp;
+	int fd, n;
+
+	for (ct = table->head.next; ct != NULL; ct = ct->next) {
+		sp = ct->sched;
+		n = snprintf(NULL, 0, "%s %s %s %s %s %s\n", sp->min, sp->hour, sp->day, sp->month, sp->dayofweek, ct->op);
+		while (len + n + 1 > cap) {
+			cap = cap ? cap * 2 : 65536;
+			buf = realloc(buf, cap);
+		}
+		len += sprintf(buf + len, "%s %s %s %s %s %s\n", sp->min, sp->hour, sp->day, sp->month, sp->dayofweek, ct->op);
+	}
+	sum = __checksum(buf, len);
+
+	sprintf(tmpname, "%s.XXXXXX", CRONTAB_FILE);
+	if ((fd = mkstemp(tmpname)) < 0) {
+		sprintf(err_str, "[compact_crontab] mkstemp error\n");
+		free(buf);
+		return -1;
+	}
+	fchmod(fd, 0644);
+	if ((len > 0 && write(fd, buf, len) != (ssize_t) len) || fsync(fd) < 0 || fstat(fd, &statbuf) < 0) {
+		snprintf(err_str, sizeof(err_str), "[compact_crontab] write error for %s\n", tmpname);
+		close(fd);
+		unlink(tmpname);
+		free(buf);
+		return -1;
+	}
+	close(fd);
+	free(buf);
+
+	if ((fp = fopen(CRONTAB_JOURNAL_NEW, "w")) == NULL) {
+		sprintf(err_str, "[compact_crontab] open error for %s\n", CRONTAB_JOURNAL_NEW);
+		unlink(tmpname);
+		return -1;
+	}
+	fprintf(fp, "%s %llu %lld %016llx %u", JOURNAL_MAGIC, (unsigned long long) statbuf.st_size,
+			(long long) statbuf.st_mtim.tv_sec * 1000000000 + statbuf.st_mtim.tv_nsec,
+			(unsigned long long) sum, table->next_id);
+	for (ct = table->head.next; ct != NULL; ct = ct->next)
+		fprintf(fp, " %u", ct->id);
+	fputc('\n', fp);
+
+	if (fflush(fp) != 0 || fsync(fileno(fp)) < 0 || fclose(fp) != 0) {
+		sprintf(err_str, "[compact_crontab] write error for %s\n", CRONTAB_JOURNAL_NEW);
+		unlink(CRONTAB_JOURNAL_NEW);
+		unlink(tmpname);
+		return -1;
+	}
+
+	// ssu_crontab_file 을 바꾼 순간부터 새 저널이 유효함
+	// rename 은 디렉토리를 fsync 해야 남으므로, 저널보다 ssu_crontab_file 이 먼저 바뀌도록 각각 fsync 함
+	if (rename(tmpname, CRONTAB_FILE) < 0) {
+		sprintf(err_str, "[compact_crontab] rename error for %s\n", CRONTAB_FILE);
+		unlink(CRONTAB_JOURNAL_NEW);
+		unlink(tmpname);
+		return -1;
+	}
+	if (__sync_dir(CRONTAB_FILE) < 0 || rename(CRONTAB_JOURNAL_NEW, CRONTAB_JOURNAL) < 0
+			|| __sync_dir(CRONTAB_JOURNAL) < 0) {
+		sprintf(err_str, "[compact_crontab] rename error for %s\n", CRONTAB_JOURNAL);
+		return -1;
+	}
+
+	// 캐시를 만들지 못해도 (쓰기 권한 등) 압축은 성공
+	write_crontab_cache(table);
+	return 0;
+}
+
+/**
+  저널을 압축할 때가 되었는지 확인하는 함수
+  @param journal_len 저널 길이
+  @param file_len ssu_crontab_file 길이
+  @return 압축해야 하면 1 아니면 0
+  */
+int journal_full(off_t journal_len, off_t file_len) {
+	return journal_len > JOURNAL_COMPACT_MIN && journal_len > file_len / JOURNAL_COMPACT_RATIO;
+}
+
+/**
+  ssu_crontab_file 과 저널을 읽고 쓰는 동안 잡는 잠금을 거는 함수
+  ssu_crontab_file 과 저널은 rename 으로 바뀌므로 그 파일들 대신 바뀌지 않는 CRONTAB_LOCK 을 잠금
+  읽기만 하는 동안은 F_RDLCK 로 여럿이 함께 읽고, 저널에 붙이거나 압축하는 동안은 F_WRLCK 로 혼자 씀
+  잠금은 열린 파일 단위이므로 같은 프로세스의 다른 스레드끼리도 막음 (한 스레드가 두 번 잡으면 안 됨)
+  @param type F_RDLCK 또는 F_WRLCK
+  @return 잠금 fd (unlock_crontab 으로 풂), 에러 시 -1 리턴하고 err_str 설정
+  */
+int lock_crontab(int type) {
+	int fd, ret;
+
+	if ((fd = open(CRONTAB_LOCK, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+		sprintf(err_str, "[lock_crontab] open error for %s\n", CRONTAB_LOCK);
+		return -1;
+	}
+
+	ret = type == F_WRLCK ? lock_file(fd) : lock_file_shared(fd);
+	if (ret < 0) {
+		sprintf(err_str, "[lock_crontab] lock error for %s\n", CRONTAB_LOCK);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+  lock_crontab 으로 건 잠금을 푸는 함수
+  @param fd lock_crontab 이 리턴한 fd (음수이면 아무것도 하지 않음)
+  */
+void unlock_crontab(int fd) {
+	if (fd < 0)
+		return;
+	unlock_file(fd);
+	close(fd);
+}
+
+/**
+  crontab 노드를 리스트에 추가하는 함수
+  @param head 원본 리스트
+  @param cp 추가할 노드
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+int add_crontab(crontab *head, crontab *cp) {
+	if (head == NULL) {
+		sprintf(err_str, "head is NULL\n");
+		return -1;
+	}
+
+	while (head->next != NULL) {
+		head = head->next;
+	}
+	head->next = cp;
+	cp->prev = head;
+	cp->next = NULL;
+	__join_schedule(cp);
+	return 0;
+}
+
+/**
+  crontab 리스트를 출력하는 함수
+  @param cp 리스트 헤드
+  @return 성공 시 리스트 엔트리 갯수, 에러 시 -1
+  */
+int print_crontab(crontab *cp) {
+	int count = 0;
+	crontab *tmp;
+
+	if (cp == NULL) {
+		sprintf(err_str, "cp is NULL\n");
+		return -1;
+	}
+
+	tmp = cp->next;
+	while (tmp != NULL) {
+		printf("%d. %s %s %s %s %s %s\n", count, tmp->sched->min, tmp->sched->hour, tmp->sched->day,
+				tmp->sched->month, tmp->sched->dayofweek, tmp->op);
+		tmp = tmp->next;
+		count++;
+	}
+	return count;
+}
+
+/**
+  crontab 노드를 리스트에서 삭제하는 함수
+  노드의 메모리는 테이블의 arena 에 있으므로 테이블을 해제할 때 함께 해제됨
+  @param cp 삭제할 노드 (헤드 노드는 불가)
+  @return 성공 시 0 에러 시 -1 리턴하고 err_str 설정
+  */
+int remove_crontab(crontab *cp) {
+	if (cp->prev == NULL) {
+		sprintf(err_str, "Cannot remove head node\n");
+		return -1;
+	}
+
+	cp->prev->next = cp->next;
+	if (cp->next != NULL) {
+		cp->next->prev = cp->prev;
+	}
+
+	cp->prev = NULL;
+	cp->next = NULL;
+	__leave_schedule(cp);
+	return 0;
+}
+
+/**
+	crontab list 가 비어있는지 확인
+	@param head 확인할 리스트 헤드 노드
+	@return 비어있으면 1 아니면 0
+	*/
+int is_empty_crontab(crontab *head) {
+	if (head == NULL)
+		return 1;
+	return head->next == NULL;
+}
+
+/**
+  로그를 남기는 함수
+  @param str 로그로 남길 문자열
+  @return 성공 시 0 에러 시 -1 리턴하고 err_str 지정
+  */
+int log_crontab(const char *str) {
+	return log_printf(CRONTAB_LOG, "%s", str);
+}
+
+/**
+  로그 파일이 logrotate 등으로 다른 파일로 바뀌었으면 다시 여는 함수 (로그 스레드)
+  잘라내기 (copytruncate) 는 O_APPEND 로 열어두었으므로 그대로 파일 끝에 이어서 씀
+  @param w 확인할 writer
+  */
+static void __log_reopen(log_writer *w) {
+	struct stat st;
+	int fd;
+
+	if (stat(w->path, &st) == 0 && st.st_dev == w->dev && st.st_ino == w->ino)
+		return;
+	if ((fd = open(w->path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666)) < 0 || fstat(fd, &st) < 0) {
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	// 다른 스레드는 fd 를 쓰지 않으므로 바로 바꿔도 안전
+	close(w->fd);
+	w->fd = fd;
+	w->dev = st.st_dev;
+	w->ino = st.st_ino;
+}
+
+/**
+  로그 스레드 함수
+  링 버퍼에 쌓인 로그들을 한 번의 writev 로 모아서 파일에 씀
+  링 버퍼가 가득 차서 버린 로그가 있으면 그 수를 로그로 남김
+  */
+static void *__log_thread(void *arg) {
+	struct iovec iov[2];
+	log_writer *w;
+	char note[SM_BUF_SIZE];
+	unsigned long dropped;
+	size_t len, off;
+	ssize_t n;
+	int idle;
+
+	(void) arg;
+	pthread_mutex_lock(&log_lock);
+	while (1) {
+		idle = 1;
+		for (int i = 0; i < log_count; i++) {
+			w = &log_writers[i];
+			if ((len = w->head - w->tail) == 0 && w->dropped == 0)
+				continue;
+
+			// [tail, head) 구간은 이 스레드만 읽으므로 잠금 없이 써도 안전
+			off = w->tail % LOG_RING_SIZE;
+			iov[0].iov_base = w->ring + off;
+			iov[0].iov_len = len < LOG_RING_SIZE - off ? len : LOG_RING_SIZE - off;
+			iov[1].iov_base = w->ring;
+			iov[1].iov_len = len - iov[0].iov_len;
+			dropped = w->dropped;
+			w->dropped = 0;
+
+			pthread_mutex_unlock(&log_lock);
+			__log_reopen(w);
+			n = len > 0 ? writev(w->fd, iov, iov[1].iov_len ? 2 : 1) : 0;
+			if (dropped > 0)
+				write(w->fd, note, snprintf(note, sizeof(note), "[log] %lu records dropped\n", dropped));
+			pthread_mutex_lock(&log_lock);
+
+			// 쓰기 실패한 로그는 버림 (로그 때문에 멈추지 않도록)
+			w->tail += n > 0 ? (size_t) n : len;
+			pthread_cond_broadcast(&log_space);
+			idle = 0;
+		}
+
+		if (idle)
+			pthread_cond_wait(&log_ready, &log_lock);
+	}
+
+	return NULL;
+}
+
+/**
+  링 버퍼에 남은 로그를 모두 파일에 쓸 때까지 기다리는 함수
+  프로세스 종료 시 (atexit) 자동으로 호출됨
+  시그널 핸들러에서 exit 하면 잠금을 잡은 채 멈춘 스레드가 있을 수 있으므로
+  잠금을 잠깐 동안만 잡아보고, 잡지 못하면 남은 로그를 버리고 돌아감
+  */
+void log_flush() {
+	for (int i = 0; pthread_mutex_trylock(&log_lock) != 0; i++) {
+		if (i == LOG_FLUSH_TRIES)
+			return;
+		usleep(1000);
+	}
+	if (log_pid == getpid()) {
+		for (int i = 0; i < log_count; i++) {
+			while (log_writers[i].head != log_writers[i].tail || log_writers[i].dropped > 0)
+				pthread_cond_wait(&log_space, &log_lock);
+		}
+	}
+	pthread_mutex_unlock(&log_lock);
+}
+
+/**
+  로그 파일의 writer 를 찾거나 새로 여는 함수 (log_lock 을 잡은 상태에서 호출)
+  @return writer, 에러 시 NULL 리턴하고 err_str 지정
+  */
+static log_writer *__log_open(const char *path) {
+	struct stat st;
+	pthread_t thread;
+	log_writer *w;
+
+	// 로그 스레드는 처음 로그를 남길 때 만듦 (daemon 이 fork 한 뒤에도 마찬가지)
+	if (log_pid != getpid()) {
+		if (pthread_create(&thread, NULL, __log_thread, NULL) != 0) {
+			sprintf(err_str, "log thread create error\n");
+			return NULL;
+		}
+		pthread_detach(thread);
+		if (log_pid == 0)
+			atexit(log_flush);
+		log_pid = getpid();
+	}
+
+	for (int i = 0; i < log_count; i++) {
+		if (!strcmp(log_writers[i].path, path))
+			return &log_writers[i];
+	}
+
+	if (log_count == LOG_MAX_FILES) {
+		sprintf(err_str, "too many log files\n");
+		return NULL;
+	}
+
+	w = &log_writers[log_count];
+	if ((w->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666)) < 0 || fstat(w->fd, &st) < 0) {
+		if (w->fd >= 0)
+			close(w->fd);
+		sprintf(err_str, "fopen error for %s\n", path);
+		return NULL;
+	}
+
+	strcpy(w->path, path);
+	w->dev = st.st_dev;
+	w->ino = st.st_ino;
+	w->ring = malloc(LOG_RING_SIZE);
+	w->head = w->tail = 0;
+	w->dropped = 0;
+	log_count++;
+	return w;
+}
+
+/**
+  "[시각] " 을 붙여서 로그를 남기는 함수
+  링 버퍼에 복사만 하고 돌아오며 실제 파일 쓰기는 로그 스레드가 모아서 처리함
+  스케줄러가 디스크를 기다리지 않도록 링 버퍼가 가득 차 있으면 기다리지 않고 버리며 (버린 수는 로그 스레드가 남김),
+  LOG_RECORD_MAX 보다 긴 로그는 잘라냄
+  @param path 로그 파일 경로 (열어둔 채로 재사용)
+  @param fmt 로그 내용 포맷
+  @return 성공 시 0, 버렸으면 1, 에러 시 -1 리턴하고 err_str 지정
+  */
+int log_printf(const char *path, const char *fmt, ...) {
+	static time_t cached_sec = -1;
+	static char cached_ts[64];
+	char buf[LOG_RECORD_MAX];
+	struct tm tm;
+	log_writer *w;
+	va_list ap;
+	time_t t;
+	size_t len, off, first;
+	int n, ret = 0;
+
+	pthread_mutex_lock(&log_lock);
+
+	if ((w = __log_open(path)) == NULL) {
+		pthread_mutex_unlock(&log_lock);
+		return -1;
+	}
+
+	// 시각 문자열은 초가 바뀔 때만 다시 만듦 (asctime 과 같은 형식)
+	t = time(NULL);
+	if (t != cached_sec) {
+		localtime_r(&t, &tm);
+		strftime(cached_ts, sizeof(cached_ts), "%a %b %e %H:%M:%S %Y", &tm);
+		cached_sec = t;
+	}
+
+	n = snprintf(buf, sizeof(buf), "[%s] ", cached_ts);
+	va_start(ap, fmt);
+	len = n + vsnprintf(buf + n, sizeof(buf) - n, fmt, ap);
+	va_end(ap);
+
+	// 긴 로그는 잘린 것을 알 수 있도록 "...\n" 으로 끝냄
+	if (len >= sizeof(buf)) {
+		len = sizeof(buf) - 1;
+		memcpy(buf + len - 4, "...\n", 4);
+	}
+
+	if (LOG_RING_SIZE - (w->head - w->tail) < len) {
+		w->dropped++;
+		ret = 1;
+	} else {
+		off = w->head % LOG_RING_SIZE;
+		first = len < LOG_RING_SIZE - off ? len : LOG_RING_SIZE - off;
+		memcpy(w->ring + off, buf, first);
+		memcpy(w->ring, buf + first, len - first);
+		w->head += len;
+	}
+	pthread_cond_signal(&log_ready);
+
+	pthread_mutex_unlock(&log_lock);
+	return ret;
+}
+
+/**
+  파싱 에러를 기록하는 함수
+  처음 발생한 에러의 위치와 메시지만 남김
+  @param ps 파서 상태
+  @param msg 에러 메시지
+  */
+static void __error(term_parser *ps, const char *msg) {
+	if (ps->result < 0)
+		return;
+
+	ps->result = -1;
+	ps->errpos = ps->p - ps->str;
+	ps->errmsg = msg;
+}
+
+/**
+  주기 문자열에서 토큰 분리해주는 함수
+  */
+static token __get_token(term_parser *ps) {
+	token t;
+	const char *tmp;
+
+	t.type = OP;
+	t.value = 0;
+	if (*ps->p == '\0') {
+		return t;
+	}
+
+	while (*ps->p == ' ')
+		ps->p++;
+
+	if (isdigit(*ps->p)) {
+		tmp = ps->p;
+		while (isdigit(*tmp))
+			t.value = t.value * 10 + *tmp++ - '0';
+		t.type = NUM;
+
+		if (t.value < 0 || t.value >= 60) {
+			__error(ps, "값은 0 이상 59 이하여야 합니다.");
+			t.type = OP;
+			t.value = 0;
+			return t;
+		}
+
+		return t;
+	}
+
+	if (*ps->p == '*')
+		t.type = RANGE;
+	else 
+		t.type = OP;
+
+	t.value = *ps->p;
+	return t;
+}
+
+/**
+  다음 토큰으로 넘어가는 함수
+  */
+static void __next_token(term_parser *ps) {
+	while (*ps->p == ' ')
+		ps->p++;
+
+	if (isdigit(*ps->p)) {
+		while (isdigit(*ps->p))
+			ps->p++;
+		return;
+	}
+	ps->p++;
+}
+
+static int __expr(term_parser *ps);
+
+/**
+  , 파싱 함수
+  */
+static token __comma(term_parser *ps) {
+	token t, t2;
+
+	t.type = OP;
+	t.value = 0;
+	if (ps->result)
+		return t;
+
+	t = __get_token(ps);
+	if (t.type == OP && t.value == 0) {
+		__error(ps, "값이 필요합니다.");
+		t.type = OP;
+		t.value = 0;
+		return t;
+	}
+
+	__next_token(ps);
+	t2 = __get_token(ps);
+	if (t2.type == OP && t2.value == ',') {
+		__next_token(ps);
+		__expr(ps);
+		return t;
+	}
+	return t;
+}
+
+/**
+  - 파싱 함수
+  */
+static token __minus(term_parser *ps, int table[60]) {
+	token t, t2, t3;
+
+	t = __comma(ps);
+	if (ps->result)
+		return t;
+
+	if (t.type == OP && t.value == ',') {
+		__error(ps, ", 앞에는 값이 와야 합니다.");
+		t.type = OP;
+		t.value = 0;
+		return t;
+	}
+
+	t2 = __get_token(ps);
+	if (t2.type == OP && t2.value == '-') {
+		// - 앞에는 무조건 숫자가 와야함
+		if (t.type != NUM) {
+			__error(ps, "- 앞에는 숫자가 와야 합니다.");
+			t.type = OP;
+			t.value = 0;
+			return t;
+		}
+
+		__next_token(ps);
+		t3 = __comma(ps);
+
+		// - 다음에는 숫자가 와야함
+		// 연산자가 오면 잘못된 수식
+		if (t3.type != NUM) {
+			__error(ps, "- 다음에는 숫자가 와야 합니다.");
+			t.type = OP;
+			t.value = 0;
+			return t;
+		}
+
+		if (t.value > t3.value) {
+			__error(ps, "- 연산자는 오른쪽의 수가 더 커야합니다.");
+			t.type = OP;
+			t.value = 0;
+			return t;
+		}
+
+		for (int i = t.value; i <= t3.value; i++)
+			table[i] = 1;
+
+		t3.type = RANGE;
+		return t3;
+	}
+	
+	return t;
+}
+
+/**
+  / 파싱 함수
+  */
+static token __slash(term_parser *ps, int table[60]) {
+	token t, t2, t3;
+
+	t = __minus(ps, table);
+	if (ps->result) {
+		t.type = OP;
+		t.value = 0;
+		return t;
+	}
+
+	//if (t.type == OP && t.value == '-') {
+	if (t.type == OP) {
+		__error(ps, "잘못된 연산자입니다.");
+		t.type = OP;
+		t.value = 0;
+		return t;
+	}
+
+	if (t.type == RANGE && t.value == '*') {
+		for (int i = 0; i < 60; i++) {
+			table[i] = 1;
+		}
+	}
+
+	t2 = __get_token(ps);
+	if (t2.type == OP && t2.value == '/') {
+		// /(슬래쉬) 앞에 *이나 범위가 아닌 숫자나 연산자가 오면 에러
+		if (t.type != RANGE) {
+			__error(ps, "/ 앞에는 * 이나 범위가 와야 합니다.");
+			t.type = OP;
+			t.value = 0;
+			return t;
+		}
+
+		__next_token(ps);
+		t3 = __minus(ps, table);
+
+		// 슬래쉬 다음에 숫자가 와야함
+		// 연산자가 오면 잘못된 수식
+		if (t3.type != NUM) {
+			__error(ps, "/ 다음에는 숫자가 와야 합니다.");
+			t.type = OP;
+			t.value = 0;
+			return t;
+		}
+
+		int count = t3.value - 1;
+		for (int i = 0; i < 60; i++) {
+			if (table[i]) {
+				if (count <= 0) {
+					count = t3.value - 1;
+				} else {
+					table[i] = 0;
+					count--;
+				}
+			}
+		}
+		return t3;
+	}
+
+	table[t.value] = 1;
+	return t;
+}
+
+/**
+  파싱 스타트 함수
+  , 로 이어진 항들은 재귀 호출되며 각자의 값들을 ps->mask 에 누적함
+  */
+static int __expr(term_parser *ps) {
+	token t;
+	int table[60];
+
+	memset(table, 0, sizeof(table));
+	t = __slash(ps, table);
+
+	if (ps->result)
+		return ps->result;
+
+	if (t.type == OP && t.value == '/') {
+		__error(ps, "잘못된 / 연산입니다.");
+		return -1;
+	}
+
+	for (int i = 0; i < 60; i++) {
+		if (table[i])
+			ps->mask |= (uint64_t) 1 << i;
+	}
+
+	if (*ps->p != '\0') {
+		__error(ps, "해석할 수 없는 문자가 있습니다.");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+  주기 문자열을 파싱하는 함수 (재진입 가능)
+  파서 상태는 모두 호출자의 스택에 있으므로 여러 스레드에서 동시에 호출해도 안전함
+  @param str 주기 문자열
+  @param res 파싱 결과. 성공 시 실행 가능한 값들의 마스크,
+             실패 시 에러 위치 (str 기준 인덱스)와 메시지
+  @return 성공 시 0, 잘못된 주기 문자열이면 -1
+  */
+int parse_term(const char *str, term_result *res) {
+	term_parser ps;
+
+	memset(&ps, 0, sizeof(ps));
+	ps.str = str;
+	ps.p = str;
+	__expr(&ps);
+
+	memset(res, 0, sizeof(*res));
+	if (ps.result < 0) {
+		res->error = 1;
+		res->errpos = ps.errpos;
+		res->errmsg = ps.errmsg;
+		return -1;
+	}
+
+	res->mask = ps.mask;
+	return 0;
+}
+
+/**
+  외부에서 파싱 요청을 하는 함수
+  @param str 주기 문자열
+  @param n n이 해당 주기문자열에서 실행가능한지 확인
+  @return n 이 해당 주기 문자열에서 실행가능하면 1 아니면 0 에러 시 -1 리턴
+  예를 들어 1-10/2 은 2, 4, 6, 8, 10 은 실행 가능하므로 n이 2면 1 리턴
+  */
+int parse_execute_term(const char *str, int n) {
+	term_result res;
+
+	if (parse_term(str, &res) < 0)
+		return -1;
+	return n >= 0 && n < 64 && (res.mask >> n & 1);
+}
+
+/**
+  주기 문자열을 파싱해서 실행 가능한 값들의 비트마스크를 만드는 함수
+  @param str 주기 문자열
+  @param mask 값 i 에서 실행 가능하면 i 번째 비트가 켜진 마스크를 저장
+  @return 성공 시 0, 잘못된 주기 문자열이면 -1 리턴하고 mask 는 0
+  */
+int parse_term_mask(const char *str, uint64_t *mask) {
+	term_result res;
+
+	if (parse_term(str, &res) < 0) {
+		*mask = 0;
+		return -1;
+	}
+
+	*mask = res.mask;
+	return 0;
+}
+
+/**
+  실행 주기의 다섯 개 주기 문자열을 비트마스크로 컴파일하는 함수
+  잘못된 주기가 있으면 해당 필드의 마스크는 0 이 되어 절대 실행되지 않음
+  @param sp 컴파일할 실행 주기
+  @return 성공 시 0, 잘못된 주기가 하나라도 있으면 -1 리턴하고 err_str 설정
+  */
+int compile_schedule(schedule *sp) {
+	int ret = 0;
+
+	ret |= parse_term_mask(sp->min, &sp->min_mask);
+	ret |= parse_term_mask(sp->hour, &sp->hour_mask);
+	ret |= parse_term_mask(sp->day, &sp->day_mask);
+	ret |= parse_term_mask(sp->month, &sp->month_mask);
+	ret |= parse_term_mask(sp->dayofweek, &sp->dow_mask);
+
+	if (ret < 0) {
+		sprintf(err_str, "[compile_schedule] invalid term in %s %s %s %s %s\n",
+				sp->min, sp->hour, sp->day, sp->month, sp->dayofweek);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+  crontab 노드의 실행 주기를 컴파일하는 함수
+  @param cp 컴파일할 노드
+  @return 성공 시 0, 잘못된 주기가 하나라도 있으면 -1 리턴하고 err_str 설정
+  */
+int compile_crontab(crontab *cp) {
+	return compile_schedule(cp->sched);
+}
+
+/**
+  옵션 값을 범위가 정해진 정수로 읽는 함수
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __opt_int(const char *name, size_t nlen, const char *val, size_t vlen, long min, long max, long *out) {
+	char buf[SM_BUF_SIZE];
+	char *end;
+
+	if (vlen == 0 || vlen >= sizeof(buf)) {
+		sprintf(err_str, "invalid value for option %.*s\n", (int) nlen, name);
+		return -1;
+	}
+	memcpy(buf, val, vlen);
+	buf[vlen] = '\0';
+
+	*out = strtol(buf, &end, 10);
+	if (*end != '\0' || *out < min || *out > max) {
+		sprintf(err_str, "option %.*s must be an integer in %ld..%ld\n", (int) nlen, name, min, max);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+  크기 옵션 값을 파싱하는 함수 (K, M, G 접미사는 1024 배수)
+  @param out 바이트 수
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __opt_size(const char *name, size_t nlen, const char *val, size_t vlen, unsigned long *out) {
+	char buf[SM_BUF_SIZE];
+	char *end;
+	int shift = 0;
+
+	if (vlen == 0 || vlen >= sizeof(buf) || *val < '0' || *val > '9') {
+		sprintf(err_str, "invalid value for option %.*s\n", (int) nlen, name);
+		return -1;
+	}
+	memcpy(buf, val, vlen);
+	buf[vlen] = '\0';
+
+	*out = strtoul(buf, &end, 10);
+	switch (*end) {
+		case 'k': case 'K': shift = 10; end++; break;
+		case 'm': case 'M': shift = 20; end++; break;
+		case 'g': case 'G': shift = 30; end++; break;
+	}
+	if (*end != '\0' || *out == 0 || *out > (~0UL >> shift)) {
+		sprintf(err_str, "option %.*s must be a positive size (K, M, G suffixes allowed)\n", (int) nlen, name);
+		return -1;
+	}
+	*out <<= shift;
+	return 0;
+}
+
+/**
+  ionice 옵션 값 ("idle", "be", "be:7", "rt:0") 을 파싱하는 함수
+  레벨을 생략하면 4 (idle 은 레벨이 없으므로 0)
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __opt_ionice(const char *val, size_t vlen, job_limits *lp) {
+	size_t clen;
+
+	for (clen = 0; clen < vlen && val[clen] != ':'; clen++)
+		;
+	if (clen == 4 && !strncmp(val, "idle", clen))
+		lp->ioclass = JOB_IOCLASS_IDLE;
+	else if (clen == 2 && !strncmp(val, "be", clen))
+		lp->ioclass = JOB_IOCLASS_BE;
+	else if (clen == 2 && !strncmp(val, "rt", clen))
+		lp->ioclass = JOB_IOCLASS_RT;
+	else {
+		sprintf(err_str, "option ionice must be idle, be[:level] or rt[:level]\n");
+		return -1;
+	}
+
+	lp->iolevel = lp->ioclass == JOB_IOCLASS_IDLE ? 0 : 4;
+	if (clen == vlen)
+		return 0;
+	if (lp->ioclass == JOB_IOCLASS_IDLE || vlen - clen != 2
+			|| val[clen + 1] < '0' || val[clen + 1] > '0' + JOB_IOLEVEL_MAX) {
+		sprintf(err_str, "ionice level must be 0..%d (none for idle)\n", JOB_IOLEVEL_MAX);
+		return -1;
+	}
+	lp->iolevel = val[clen + 1] - '0';
+	return 0;
+}
+
+/**
+  affinity 옵션 값 (16진수 CPU 비트마스크, "0x" 는 생략 가능) 을 파싱하는 함수
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __opt_affinity(const char *val, size_t vlen, uint64_t *out) {
+	char buf[SM_BUF_SIZE];
+	char *end;
+
+	if (vlen == 0 || vlen >= sizeof(buf) || *val == '-' || *val == '+') {
+		sprintf(err_str, "invalid value for option affinity\n");
+		return -1;
+	}
+	memcpy(buf, val, vlen);
+	buf[vlen] = '\0';
+
+	errno = 0;
+	*out = strtoull(buf, &end, 16);
+	if (*end != '\0' || *out == 0 || errno == ERANGE) {
+		sprintf(err_str, "option affinity must be a non-zero hex CPU mask (e.g. 0x0f)\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+  이름=값 옵션 하나를 opts 에 반영하는 함수
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __set_job_opt(job_opts *opts, const char *name, size_t nlen, const char *val, size_t vlen) {
+	long v;
+
+	if (nlen == 8 && !strncmp(name, "priority", nlen)) {
+		if (__opt_int(name, nlen, val, vlen, JOB_PRIORITY_MIN, JOB_PRIORITY_MAX, &v) < 0)
+			return -1;
+		opts->priority = v;
+		return 0;
+	}
+
+	if (nlen == 6 && !strncmp(name, "jitter", nlen)) {
+		if (__opt_int(name, nlen, val, vlen, 0, JOB_JITTER_MAX, &v) < 0)
+			return -1;
+		opts->jitter = v;
+		return 0;
+	}
+
+	if (nlen == 7 && !strncmp(name, "overlap", nlen)) {
+		if ((opts->overlap = parse_name(overlap_names, val, vlen)) < 0) {
+			sprintf(err_str, "option overlap must be one of allow, skip, queue, kill\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (nlen == 7 && !strncmp(name, "catchup", nlen)) {
+		if ((opts->catchup = parse_name(catchup_names, val, vlen)) < 0) {
+			sprintf(err_str, "option catchup must be one of none, once, all\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (nlen == 4 && !strncmp(name, "nice", nlen)) {
+		if (__opt_int(name, nlen, val, vlen, JOB_NICE_MIN, JOB_NICE_MAX, &v) < 0)
+			return -1;
+		opts->limits.nice = v;
+		return 0;
+	}
+
+	if (nlen == 6 && !strncmp(name, "ionice", nlen))
+		return __opt_ionice(val, vlen, &opts->limits);
+
+	if (nlen == 8 && !strncmp(name, "affinity", nlen))
+		return __opt_affinity(val, vlen, &opts->limits.affinity);
+
+	if (nlen == 8 && !strncmp(name, "memlimit", nlen))
+		return __opt_size(name, nlen, val, vlen, &opts->limits.mem);
+
+	if (nlen == 8 && !strncmp(name, "cpulimit", nlen)) {
+		if (__opt_int(name, nlen, val, vlen, 1, INT_MAX, &v) < 0)
+			return -1;
+		opts->limits.cpu = v;
+		return 0;
+	}
+
+	if (nlen == 7 && !strncmp(name, "timeout", nlen)) {
+		if (__opt_int(name, nlen, val, vlen, 1, INT_MAX, &v) < 0)
+			return -1;
+		opts->limits.timeout = v;
+		return 0;
+	}
+
+	sprintf(err_str, "unknown option %.*s\n", (int) (nlen < SM_BUF_SIZE ? nlen : SM_BUF_SIZE), name);
+	return -1;
+}
+
+/**
+  정책 이름을 이름 목록의 번호로 바꾸는 함수
+  @param names 이름 목록 (overlap_names, catchup_names), NULL 로 끝남
+  @param val 정책 이름 (NULL 로 끝나지 않아도 됨)
+  @param len 이름 길이
+  @return 목록에서의 번호 (OVERLAP_*, CATCHUP_*), 모르는 이름이면 -1
+  */
+int parse_name(const char *const names[], const char *val, size_t len) {
+	for (int i = 0; names[i] != NULL; i++) {
+		if (strlen(names[i]) == len && !strncmp(val, names[i], len))
+			return i;
+	}
+	return -1;
+}
+
+/**
+  명령어를 띄울 때 걸어야 할 제한이 있는지 확인하는 함수
+  timeout 은 daemon 이 실행 중에 지켜보므로 포함하지 않음
+  @param lp 확인할 제한
+  @return 있으면 1 아니면 0
+  */
+int job_limited(const job_limits *lp) {
+	return lp->nice != JOB_NICE_KEEP || lp->ioclass != JOB_IOCLASS_NONE || lp->affinity != 0
+		|| lp->mem != 0 || lp->cpu != 0;
+}
+
+/**
+  명령어 앞의 실행 옵션을 파싱하는 함수
+  옵션은 "[이름=값 이름=값] 명령어" 형태이며 이름=값 사이는 공백이나 쉼표로 구분함
+  @param op 명령어 문자열
+  @param opts 파싱 결과 (옵션이 없으면 기본값, cmd 는 op 안의 명령어 시작 위치)
+  @return 성공 시 0, 잘못된 옵션이면 -1 리턴하고 err_str 설정
+  */
+int parse_job_opts(const char *op, job_opts *opts) {
+	const char *p = op, *name, *val;
+	size_t nlen;
+
+	memset(opts, 0, sizeof(job_opts));
+	opts->jitter = -1;
+	opts->overlap = -1;
+	opts->catchup = -1;
+	opts->limits.nice = JOB_NICE_KEEP;
+	opts->cmd = op;
+	if (*p++ != '[')
+		return 0;
+
+	while (1) {
+		while (*p == ' ' || *p == '\t' || *p == ',')
+			p++;
+		if (*p == ']')
+			break;
+		if (*p == '\0') {
+			sprintf(err_str, "missing ] after options\n");
+			return -1;
+		}
+
+		for (name = p; *p != '=' && *p != ']' && *p != '\0' && *p != ' ' && *p != '\t' && *p != ','; p++)
+			;
+		if (*p != '=' || p == name) {
+			sprintf(err_str, "option must be name=value\n");
+			return -1;
+		}
+		nlen = p - name;
+
+		for (val = ++p; *p != ']' && *p != '\0' && *p != ' ' && *p != '\t' && *p != ','; p++)
+			;
+		if (__set_job_opt(opts, name, nlen, val, p - val) < 0)
+			return -1;
+	}
+
+	for (p++; *p == ' ' || *p == '\t'; p++)
+		;
+	if (*p == '\0') {
+		sprintf(err_str, "missing command after options\n");
+		return -1;
+	}
+	opts->cmd = p;
+	return 0;
+}
+
+/**
+  주어진 시각에 실행 주기가 맞는지 확인하는 함수
+  컴파일된 비트마스크만 검사하므로 주기 문자열을 다시 파싱하지 않음
+  @param sp 확인할 실행 주기 (compile_schedule 로 컴파일 되어 있어야 함)
+  @param tm 확인할 시각
+  @return 실행해야 하면 1 아니면 0
+  */
+int match_schedule(const schedule *sp, const struct tm *tm) {
+	return (sp->min_mask >> tm->tm_min & 1) &&
+		(sp->hour_mask >> tm->tm_hour & 1) &&
+		(sp->day_mask >> tm->tm_mday & 1) &&
+		(sp->month_mask >> (tm->tm_mon + 1) & 1) &&
+		(sp->dow_mask >> tm->tm_wday & 1);
+}
+
+/**
+  주어진 시각에 crontab 노드가 실행되어야 하는지 확인하는 함수
+  @param cp 확인할 노드
+  @param tm 확인할 시각
+  @return 실행해야 하면 1 아니면 0
+  */
+int match_crontab(const crontab *cp, const struct tm *tm) {
+	return match_schedule(cp->sched, tm);
+}
+
+/**
+  mask 에서 from 이상 limit 미만인 가장 작은 켜진 비트를 찾는 함수
+  @return 찾은 비트 위치, 없으면 -1
   */
-int add_crontab(crontab *head, crontab *cp) {
-	if (head == NULL) {
-		sprintf(err_str, "head is NULL\n");
+static int __next_bit(uint64_t mask, int from, int limit) {
+	int bit;
+
+	if (from >= 64 || (mask >>= from) == 0)
 		return -1;
-	}
 
-	while (head->next != NULL) {
-		head = head->next;
-	}
-	head->next = cp;
-	cp->prev = head;
-	return 0;
+	bit = from + __builtin_ctzll(mask);
+	if (bit >= limit)
+		return -1;
+	return bit;
 }
 
 /**
-  crontab 리스트를 출력하는 함수
-  @param cp 리스트 헤드
-  @return 성공 시 리스트 엔트리 갯수, 에러 시 -1
+  after 이후 처음으로 실행 주기가 맞는 시각을 계산하는 함수
+  분 단위로 하나씩 확인하지 않고 월 -> 일 -> 시 -> 분 순서로 맞지 않는 단위를 통째로 건너뜀
+  @param cp 계산할 실행 주기 (compile_schedule 로 컴파일 되어 있어야 함)
+  @param after 기준 시각 (결과는 항상 after 보다 큼)
+  @return 다음 실행 시각, 실행될 수 없는 주기이면 -1
   */
-int print_crontab(crontab *cp) {
-	int count = 0;
-	crontab *tmp;
+time_t next_fire_time(const schedule *cp, time_t after) {
+	struct tm tm;
+	time_t t;
+	int next, end_year;
 
-	if (cp == NULL) {
-		sprintf(err_str, "cp is NULL\n");
+	if (!cp->min_mask || !cp->hour_mask || !cp->day_mask || !cp->month_mask || !cp->dow_mask)
 		return -1;
-	}
 
-	tmp = cp->next;
-	while (tmp != NULL) {
-		printf("%d. %s %s %s %s %s %s\n", count, tmp->min, tmp->hour, tmp->day, tmp->month, tmp->dayofweek, tmp->op);
-		tmp = tmp->next;
-		count++;
+	localtime_r(&after, &tm);
+	tm.tm_sec = 0;
+	tm.tm_min++;
+	tm.tm_isdst = -1;
+	mktime(&tm);
+
+	// 2월 31일 등 영영 실행될 수 없는 조합을 대비해 탐색 범위를 제한
+	end_year = tm.tm_year + NEXT_FIRE_YEARS;
+	while (tm.tm_year <= end_year) {
+		if (!(cp->month_mask >> (tm.tm_mon + 1) & 1)) {
+			tm.tm_mon++;
+			tm.tm_mday = 1;
+			tm.tm_hour = 0;
+			tm.tm_min = 0;
+		}
+		else if (!(cp->day_mask >> tm.tm_mday & 1) || !(cp->dow_mask >> tm.tm_wday & 1)) {
+			tm.tm_mday++;
+			tm.tm_hour = 0;
+			tm.tm_min = 0;
+		}
+		else if ((next = __next_bit(cp->hour_mask, tm.tm_hour, 24)) != tm.tm_hour) {
+			if (next < 0) {
+				tm.tm_mday++;
+				tm.tm_hour = 0;
+			}
+			else
+				tm.tm_hour = next;
+			tm.tm_min = 0;
+		}
+		else if ((next = __next_bit(cp->min_mask, tm.tm_min, 60)) != tm.tm_min) {
+			if (next < 0) {
+				tm.tm_hour++;
+				tm.tm_min = 0;
+			}
+			else
+				tm.tm_min = next;
+		}
+		else {
+			// 모든 단위가 맞음
+			tm.tm_isdst = -1;
+			if ((t = mktime(&tm)) > after)
+				return t;
+			tm.tm_min++;
+		}
+
+		// 넘친 단위 정리 (서머타임으로 존재하지 않는 시각도 여기서 보정됨)
+		tm.tm_isdst = -1;
+		mktime(&tm);
 	}
-	return count;
+
+	return -1;
 }
 
 /**
-  crontab 노드를 리스트에서 삭제하는 함수
-  @param cp 삭제할 노드 (헤드 노드는 불가)
-  @return 성공 시 0 에러 시 -1 리턴하고 err_str 설정
+  테이블의 서로 다른 실행 주기들의 마스크를 종류별 배열로 모으는 함수
+  엔트리가 없는 실행 주기는 제외함
+  @param cols 결과를 저장할 표
+  @param table 컴파일된 crontab 테이블
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
   */
-int remove_crontab(crontab *cp) {
-	if (cp->prev == NULL) {
-		sprintf(err_str, "Cannot remove head node\n");
+int build_crontab_columns(crontab_columns *cols, const crontab_table *table) {
+	const schedule *sp;
+	size_t cap = 64, size;
+	uint64_t *buf;
+	int n = 0;
+
+	for (sp = table->scheds; sp != NULL; sp = sp->next)
+		n += sp->job_count > 0;
+	while (cap < (size_t) n)
+		cap <<= 1;
+
+	// 남는 칸은 마스크가 0 이므로 절대 실행되지 않음
+	// aligned_alloc 의 크기는 정렬 단위의 배수여야 하므로 32 바이트 단위로 올림
+	size = ((cap * 5 + cap / 64) * sizeof(uint64_t) + 31) & ~(size_t) 31;
+	if ((buf = aligned_alloc(32, size)) == NULL
+			|| (cols->scheds = malloc(cap * sizeof(schedule *))) == NULL) {
+		free(buf);
+		sprintf(err_str, "[build_crontab_columns] malloc error\n");
 		return -1;
 	}
+	memset(buf, 0, size);
 
-	cp->prev->next = cp->next;
-	if (cp->next != NULL) {
-		cp->next->prev = cp->prev;
-	}
+	cols->min = buf;
+	cols->hour = buf + cap;
+	cols->day = buf + cap * 2;
+	cols->month = buf + cap * 3;
+	cols->dow = buf + cap * 4;
+	cols->active = buf + cap * 5;
+	cols->words = cap / 64;
+	cols->active_key = -1;
+	cols->count = n;
 
-	cp->prev = NULL;
-	cp->next = NULL;
-	free(cp);
+	n = 0;
+	for (sp = table->scheds; sp != NULL; sp = sp->next) {
+		if (sp->job_count == 0)
+			continue;
+		cols->min[n] = sp->min_mask;
+		cols->hour[n] = sp->hour_mask;
+		cols->day[n] = sp->day_mask;
+		cols->month[n] = sp->month_mask;
+		cols->dow[n] = sp->dow_mask;
+		cols->scheds[n++] = (schedule *) sp;
+	}
 	return 0;
 }
 
 /**
-	crontab list 가 비어있는지 확인
-	@param head 확인할 리스트 헤드 노드
-	@return 비어있으면 1 아니면 0
-	*/
-int is_empty_crontab(crontab *head) {
-	if (head == NULL)
-		return 1;
-	return head->next == NULL;
+  build_crontab_columns 로 만든 표를 해제하는 함수
+  */
+void free_crontab_columns(crontab_columns *cols) {
+	free(cols->min);
+	free(cols->scheds);
+	memset(cols, 0, sizeof(crontab_columns));
 }
 
+// 시, 일, 월, 요일 마스크를 AND 해서 active 비트셋을 만드는 함수 (sh: 시, 일, 월, 요일 비트 위치)
+typedef void (*active_kernel)(crontab_columns *c, const int sh[4]);
+
+// active 주기 중 분 마스크가 맞는 주기의 인덱스를 모으는 함수
+typedef int (*due_kernel)(const crontab_columns *c, int min, int *idx);
+
 /**
-  로그를 남기는 함수
-  @param str 로그로 남길 문자열
-  @return 성공 시 0 에러 시 -1 리턴하고 err_str 지정
+  active 비트셋 계산의 기본 구현, 한 주기씩 검사함
   */
-int log_crontab(const char *str) {
-	struct tm *tm;
-	time_t t;
-	FILE *fp;
-
-	if ((fp = fopen(CRONTAB_LOG, "a+")) == NULL) {
-		sprintf(err_str, "fopen error for %s\n", CRONTAB_LOG);
-		return -1;
+static void __active_scalar(crontab_columns *c, const int sh[4]) {
+	memset(c->active, 0, c->words * sizeof(uint64_t));
+	for (int i = 0; i < c->count; i++) {
+		if (c->hour[i] >> sh[0] & c->day[i] >> sh[1] & c->month[i] >> sh[2] & c->dow[i] >> sh[3] & 1)
+			c->active[i >> 6] |= 1ULL << (i & 63);
 	}
-
-	t = time(NULL);
-	tm = localtime(&t);
-	fprintf(fp, "[%s] %s", strtok(asctime(tm), "\n"), str);
-
-	fclose(fp);
-	return 0;
 }
 
 /**
-  주기 문자열에서 토큰 분리해주는 함수
+  분 검사의 기본 구현, active 비트가 켜진 주기만 검사함
   */
-static token __get_token() {
-	token t;
-	char *tmp;
+static int __due_scalar(const crontab_columns *c, int min, int *idx) {
+	uint64_t w;
+	int count = 0, i;
 
-	t.type = OP;
-	t.value = 0;
-	if (*extermp == '\0') {
-		return t;
+	for (size_t b = 0; b < c->words; b++) {
+		for (w = c->active[b]; w; w &= w - 1) {
+			i = b * 64 + __builtin_ctzll(w);
+			if (c->min[i] >> min & 1)
+				idx[count++] = i;
+		}
 	}
+	return count;
+}
 
-	while (*extermp == ' ')
-		extermp++;
-
-	if (isdigit(*extermp)) {
-		tmp = extermp;
-		while (isdigit(*tmp))
-			t.value = t.value * 10 + *tmp++ - '0';
-		t.type = NUM;
+#if defined(__SSE2__)
+/**
+  active 비트셋 계산의 SSE2 구현, 주기 두 개씩 검사함
+  */
+static void __active_sse2(crontab_columns *c, const int sh[4]) {
+	__m128i s0 = _mm_cvtsi32_si128(sh[0]), s1 = _mm_cvtsi32_si128(sh[1]);
+	__m128i s2 = _mm_cvtsi32_si128(sh[2]), s3 = _mm_cvtsi32_si128(sh[3]);
+	__m128i v;
 
-		if (t.value < 0 || t.value >= 60) {
-			result = -1;
-			t.type = OP;
-			t.value = 0;
-			return t;
-		}
+	memset(c->active, 0, c->words * sizeof(uint64_t));
+	for (int i = 0; i < c->count; i += 2) {
+		v = _mm_srl_epi64(_mm_load_si128((const __m128i *) (c->hour + i)), s0);
+		v = _mm_and_si128(v, _mm_srl_epi64(_mm_load_si128((const __m128i *) (c->day + i)), s1));
+		v = _mm_and_si128(v, _mm_srl_epi64(_mm_load_si128((const __m128i *) (c->month + i)), s2));
+		v = _mm_and_si128(v, _mm_srl_epi64(_mm_load_si128((const __m128i *) (c->dow + i)), s3));
 
-		return t;
+		// 0번 비트를 부호 비트로 옮겨서 주기별로 한 비트씩 모음
+		c->active[i >> 6] |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(_mm_slli_epi64(v, 63))) << (i & 63);
 	}
-
-	if (*extermp == '*')
-		t.type = RANGE;
-	else 
-		t.type = OP;
-
-	t.value = *extermp;
-	return t;
 }
 
 /**
-  다음 토큰으로 넘어가는 함수
+  분 검사의 SSE2 구현, active 주기가 있는 64개 묶음마다 분 마스크 비트셋을 만들어 AND 함
   */
-static void __next_token() {
-	while (*extermp == ' ')
-		extermp++;
+static int __due_sse2(const crontab_columns *c, int min, int *idx) {
+	__m128i sm = _mm_cvtsi32_si128(min), v;
+	uint64_t hit;
+	int count = 0;
 
-	if (isdigit(*extermp)) {
-		while (isdigit(*extermp))
-			extermp++;
-		return;
+	for (size_t b = 0; b < c->words; b++) {
+		if (c->active[b] == 0)
+			continue;
+
+		hit = 0;
+		for (int k = 0; k < 64; k += 2) {
+			v = _mm_srl_epi64(_mm_load_si128((const __m128i *) (c->min + b * 64 + k)), sm);
+			hit |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(_mm_slli_epi64(v, 63))) << k;
+		}
+		for (hit &= c->active[b]; hit; hit &= hit - 1)
+			idx[count++] = b * 64 + __builtin_ctzll(hit);
 	}
-	extermp++;
+	return count;
 }
+#endif
 
+#if defined(__x86_64__) || defined(__i386__)
 /**
-  , 파싱 함수
+  active 비트셋 계산의 AVX2 구현, 주기 네 개씩 검사함
   */
-static token __comma(int n) {
-	token t, t2;
-	if (result)
-		return t;
-
-	t = __get_token();
-	if (t.type == OP && t.value == 0) {
-		result = -1;
-		t.type = OP;
-		t.value = 0;
-		return t;
-	}
+__attribute__((target("avx2")))
+static void __active_avx2(crontab_columns *c, const int sh[4]) {
+	__m128i s0 = _mm_cvtsi32_si128(sh[0]), s1 = _mm_cvtsi32_si128(sh[1]);
+	__m128i s2 = _mm_cvtsi32_si128(sh[2]), s3 = _mm_cvtsi32_si128(sh[3]);
+	__m256i v;
 
-	__next_token();
-	t2 = __get_token();
-	if (t2.type == OP && t2.value == ',') {
-		__next_token();
-		__expr(n);
-		return t;
+	memset(c->active, 0, c->words * sizeof(uint64_t));
+	for (int i = 0; i < c->count; i += 4) {
+		v = _mm256_srl_epi64(_mm256_load_si256((const __m256i *) (c->hour + i)), s0);
+		v = _mm256_and_si256(v, _mm256_srl_epi64(_mm256_load_si256((const __m256i *) (c->day + i)), s1));
+		v = _mm256_and_si256(v, _mm256_srl_epi64(_mm256_load_si256((const __m256i *) (c->month + i)), s2));
+		v = _mm256_and_si256(v, _mm256_srl_epi64(_mm256_load_si256((const __m256i *) (c->dow + i)), s3));
+		c->active[i >> 6] |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(v, 63))) << (i & 63);
 	}
-	return t;
 }
 
 /**
-  - 파싱 함수
+  분 검사의 AVX2 구현, active 주기가 있는 64개 묶음마다 분 마스크 비트셋을 만들어 AND 함
   */
-static token __minus(int n, int table[60]) {
-	token t, t2, t3;
-
-	t = __comma(n);
-	if (result)
-		return t;
+__attribute__((target("avx2")))
+static int __due_avx2(const crontab_columns *c, int min, int *idx) {
+	__m128i sm = _mm_cvtsi32_si128(min);
+	__m256i v;
+	uint64_t hit;
+	int count = 0;
 
-	if (t.type == OP && t.value == ',') {
-		result = -1;
-		t.type = OP;
-		t.value = 0;
-		return t;
-	}
+	for (size_t b = 0; b < c->words; b++) {
+		if (c->active[b] == 0)
+			continue;
 
-	t2 = __get_token();
-	if (t2.type == OP && t2.value == '-') {
-		// - 앞에는 무조건 숫자가 와야함
-		if (t.type != NUM) {
-			result = -1;
-			t.type = OP;
-			t.value = 0;
-			return t;
+		hit = 0;
+		for (int k = 0; k < 64; k += 4) {
+			v = _mm256_srl_epi64(_mm256_load_si256((const __m256i *) (c->min + b * 64 + k)), sm);
+			hit |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(v, 63))) << k;
 		}
+		for (hit &= c->active[b]; hit; hit &= hit - 1)
+			idx[count++] = b * 64 + __builtin_ctzll(hit);
+	}
+	return count;
+}
+#endif
 
-		__next_token();
-		t3 = __comma(n);
+/**
+  주어진 시각에 맞는 실행 주기들의 인덱스를 구하는 함수
+  노드를 따라가지 않고 마스크 배열을 훑으며, CPU 가 지원하면 AVX2 나 SSE2 를 사용함
+  시, 일, 월, 요일은 한 시간 동안 바뀌지 않으므로 그 결과를 active 비트셋으로 한 시간에 한 번만 계산하고,
+  매 분에는 active 주기의 분 마스크만 읽음
+  @param cols 검사할 표
+  @param tm 검사할 시각
+  @param idx 맞는 실행 주기 인덱스들을 오름차순으로 저장 (cols->count 개 이상)
+  @return 맞는 실행 주기 수
+  */
+int due_crontab_columns(crontab_columns *cols, const struct tm *tm, int *idx) {
+	static active_kernel active;
+	static due_kernel due;
+	const int sh[4] = { tm->tm_hour, tm->tm_mday, tm->tm_mon + 1, tm->tm_wday };
+	long key = ((long) tm->tm_year * 400 + tm->tm_yday) * 24 + tm->tm_hour;
 
-		// - 다음에는 숫자가 와야함
-		// 연산자가 오면 잘못된 수식
-		if (t3.type != NUM) {
-			result = -1;
-			t.type = OP;
-			t.value = 0;
-			return t;
+	if (active == NULL) {
+		active = __active_scalar;
+		due = __due_scalar;
+#if defined(__SSE2__)
+		active = __active_sse2;
+		due = __due_sse2;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+		if (__builtin_cpu_supports("avx2")) {
+			active = __active_avx2;
+			due = __due_avx2;
 		}
+#endif
+	}
 
-		if (t.value > t3.value) {
-			printf("- 연산자는 오른쪽의 수가 더 커야합니다.\n");
-			t.type = OP;
-			t.value = 0;
-			result = -1;
-			return t;
-		}
+	if (cols->active_key != key) {
+		active(cols, sh);
+		cols->active_key = key;
+	}
+	return due(cols, tm->tm_min, idx);
+}
 
-		for (int i = t.value; i <= t3.value; i++)
-			table[i] = 1;
+/**
+  실행 주기의 내용(다섯 개 주기 문자열)으로 해시값을 만드는 함수 (FNV-1a)
+  @param sp 해시할 실행 주기
+  @return 해시값
+  */
+uint32_t hash_schedule(const schedule *sp) {
+	const char *fields[5] = { sp->min, sp->hour, sp->day, sp->month, sp->dayofweek };
+	size_t lens[5];
 
-		t3.type = RANGE;
-		return t3;
-	}
-	
-	return t;
+	for (int i = 0; i < 5; i++)
+		lens[i] = strlen(fields[i]);
+	return __hash_fields(fields, lens);
 }
 
 /**
-  / 파싱 함수
+  두 실행 주기의 내용이 같은지 확인하는 함수
+  @return 다섯 개 주기 문자열이 모두 같으면 1 아니면 0
   */
-static token __slash(int n, int table[60]) {
-	token t, t2, t3;
+int equal_schedule(const schedule *lhs, const schedule *rhs) {
+	return !strcmp(lhs->min, rhs->min) &&
+		!strcmp(lhs->hour, rhs->hour) &&
+		!strcmp(lhs->day, rhs->day) &&
+		!strcmp(lhs->month, rhs->month) &&
+		!strcmp(lhs->dayofweek, rhs->dayofweek);
+}
 
-	t = __minus(n, table);
-	if (result) {
-		t.type = OP;
-		t.value = 0;
-		return t;
-	}
+/**
+  제어 소켓 메시지 하나를 보내는 함수
+  @param fd 연결된 소켓
+  @param type CTL_* 요청 또는 응답 종류
+  @param body 본문 (len 이 0 이면 NULL 가능)
+  @param len 본문 길이
+  @return 성공 시 0, 에러 시 -1
+  */
+int ctl_send(int fd, int type, const void *body, uint32_t len) {
+	ctl_header hdr;
+	struct iovec iov[2];
+	struct msghdr msg;
+	ssize_t n;
 
-	//if (t.type == OP && t.value == '-') {
-	if (t.type == OP) {
-		t.type = OP;
-		t.value = 0;
-		result = -1;
-		return t;
-	}
+	memset(&hdr, 0, sizeof(hdr));
+	memset(&msg, 0, sizeof(msg));
+	hdr.type = type;
+	hdr.len = len;
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *) body;
+	iov[1].iov_len = len;
 
-	if (t.type == RANGE && t.value == '*') {
-		for (int i = 0; i < 60; i++) {
-			table[i] = 1;
+	// 소켓 버퍼보다 긴 본문은 나눠서 써짐
+	// 상대가 먼저 끊어도 SIGPIPE 로 죽지 않고 에러로 받음
+	for (int i = 0; i < 2; ) {
+		msg.msg_iov = iov + i;
+		msg.msg_iovlen = 2 - i;
+		if ((n = sendmsg(fd, &msg, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
 		}
-	}
-
-	t2 = __get_token();
-	if (t2.type == OP && t2.value == '/') {
-		// /(슬래쉬) 앞에 *이나 범위가 아닌 숫자나 연산자가 오면 에러
-		if (t.type != RANGE) {
-			result = -1;
-			t.type = OP;
-			t.value = 0;
-			return t;
+		for (; i < 2 && (size_t) n >= iov[i].iov_len; i++)
+			n -= iov[i].iov_len;
+		if (i < 2) {
+			iov[i].iov_base = (char *) iov[i].iov_base + n;
+			iov[i].iov_len -= n;
 		}
+	}
+	return 0;
+}
 
-		__next_token();
-		t3 = __minus(n, table);
+/**
+  제어 소켓 메시지 하나를 받는 함수
+  @param fd 연결된 소켓
+  @param hdr 헤더 저장
+  @param body 본문 저장 (새로 할당, NULL 로 끝남)
+  @param max 받을 수 있는 본문 최대 길이
+  @return 성공 시 0, 에러나 너무 긴 본문이면 -1 리턴하고 err_str 설정
+  */
+int ctl_recv(int fd, ctl_header *hdr, char **body, uint32_t max) {
+	char *p = (char *) hdr;
+	size_t want = sizeof(ctl_header);
+	ssize_t n;
 
-		// 슬래쉬 다음에 숫자가 와야함
-		// 연산자가 오면 잘못된 수식
-		if (t3.type != NUM) {
-			result = -1;
-			t.type = OP;
-			t.value = 0;
-			return t;
+	*body = NULL;
+	for (int part = 0; part < 2; part++) {
+		while (want > 0) {
+			if ((n = read(fd, p, want)) <= 0) {
+				if (n < 0 && errno == EINTR)
+					continue;
+				free(*body);
+				*body = NULL;
+				sprintf(err_str, "control socket read error\n");
+				return -1;
+			}
+			p += n;
+			want -= n;
 		}
 
-		int count = t3.value - 1;
-		for (int i = 0; i < 60; i++) {
-			if (table[i]) {
-				if (count <= 0) {
-					count = t3.value - 1;
-				} else {
-					table[i] = 0;
-					count--;
-				}
+		// 상대가 보낸 길이는 믿지 않고 max 까지만 받음
+		if (part == 0) {
+			if (hdr->len > max) {
+				sprintf(err_str, "control message is too long (%u bytes)\n", hdr->len);
+				return -1;
+			}
+			if ((p = *body = malloc((size_t) hdr->len + 1)) == NULL) {
+				sprintf(err_str, "control message allocation error\n");
+				return -1;
 			}
+			want = hdr->len;
 		}
-		return t3;
 	}
 
-	table[t.value] = 1;
-	return t;
+	(*body)[hdr->len] = '\0';
+	return 0;
 }
 
 /**
-  파싱 스타트 함수
+  ssu_crond 제어 소켓에 요청 하나를 보내고 응답을 받는 함수
+  @param path 제어 소켓 경로
+  @param type CTL_* 요청 종류
+  @param body 요청 본문
+  @param len 요청 본문 길이
+  @param reply 응답 본문 저장 (새로 할당, NULL 로 끝남)
+  @return 응답 종류 (CTL_OK, CTL_ERROR), ssu_crond 에 연결하지 못하면 -1 리턴하고 err_str 설정
+          연결한 뒤 통신 에러면 reply 가 NULL 인 CTL_ERROR 리턴하고 err_str 설정
   */
-static int __expr(int n) {
-	token t;
-	int table[60];
-
-	memset(table, 0, sizeof(table));
-	t = __slash(n, table);
-
-	if (result)
-		return result;
+int ctl_request(const char *path, int type, const void *body, uint32_t len, char **reply) {
+	struct sockaddr_un addr;
+	ctl_header hdr;
+	int fd;
 
-	if (t.type == OP && t.value == '/') {
+	*reply = NULL;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		sprintf(err_str, "control socket path is too long\n");
 		return -1;
 	}
+	strcpy(addr.sun_path, path);
 
-	/*
-	for (int i = 0; i < 60; i++) {
-		if (table[i])
-			printf("%d ", i);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		sprintf(err_str, "ssu_crond is not running\n");
+		close(fd);
+		return -1;
 	}
-	printf("\n");
-	*/
 
-	if (n >= 0 && table[n] > 0) {
-		result = 1;
-		return 1;
+	// 보낸 뒤에는 ssu_crond 가 요청을 처리했을 수 있으므로 연결 실패와 구분함
+	if (ctl_send(fd, type, body, len) < 0) {
+		sprintf(err_str, "control socket error\n");
+		close(fd);
+		return CTL_ERROR;
+	}
+	if (ctl_recv(fd, &hdr, reply, CTL_MAX_REPLY) < 0) {
+		close(fd);
+		return CTL_ERROR;
 	}
 
-	if (strlen(extermp) > 0)
-		return -1;
-	return 0;
+	close(fd);
+	return hdr.type;
 }
 
 /**
-  외부에서 파싱 요청을 하는 함수
-  @param str 주기 문자열
-  @param n n이 해당 주기문자열에서 실행가능한지 확인
-  @return n 이 해당 주기 문자열에서 실행가능하면 1 아니면 0 에러 시 -1 리턴
-  예를 들어 1-10/2 은 2, 4, 6, 8, 10 은 실행 가능하므로 n이 2면 1 리턴
+  파일 전체에 fcntl 레코드 잠금을 거는 함수 (잠금을 얻을 때까지 기다림)
+  열린 파일 단위의 잠금 (F_OFD_SETLKW) 이므로 같은 파일의 다른 fd 를 닫아도 풀리지 않음
+  @param fd 잠글 파일
+  @param type F_RDLCK, F_WRLCK 또는 F_UNLCK
+  @return 성공 시 0, 에러 시 -1
   */
-int parse_execute_term(const char *str, int n) {
-	memset(exterm, 0, sizeof(exterm));
-	strcpy(exterm, str);
-	result = 0;
-	extermp = exterm;
-	int ret = __expr(n);
+static int __lock_file(int fd, int type) {
+	struct flock fl;
+	int ret;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 0;
+
+	while ((ret = fcntl(fd, type == F_UNLCK ? F_OFD_SETLK : F_OFD_SETLKW, &fl)) < 0 && errno == EINTR)
+		;
 	return ret;
 }
+
+/**
+  파일에 배타적 잠금을 거는 함수 (쓰는 쪽)
+  @param fd 잠글 파일 (쓰기로 열려 있어야 함)
+  @return 성공 시 0, 에러 시 -1
+  */
+int lock_file(int fd) {
+	return __lock_file(fd, F_WRLCK);
+}
+
+/**
+  파일에 공유 잠금을 거는 함수 (읽는 쪽)
+  @param fd 잠글 파일 (읽기로 열려 있어야 함)
+  @return 성공 시 0, 에러 시 -1
+  */
+int lock_file_shared(int fd) {
+	return __lock_file(fd, F_RDLCK);
+}
+
+/**
+  lock_file, lock_file_shared 로 건 잠금을 푸는 함수
+  @param fd 잠근 파일
+  @return 성공 시 0, 에러 시 -1
+  */
+int unlock_file(int fd) {
+	return __lock_file(fd, F_UNLCK);
+}
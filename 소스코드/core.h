@@ -1,42 +1,266 @@
 #ifndef H_CORE
-#define HCORE 1
+#define H_CORE 1
+
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
 
 #define BUF_SIZE 1024
 #define SM_BUF_SIZE 64
 #define STD_ID "20162489"
 #define CRONTAB_FILE "ssu_crontab_file"
 #define CRONTAB_LOG "ssu_crontab_log"
+#define CRONTAB_CACHE "ssu_crontab_file.cache"	// 컴파일된 crontab 캐시
+#define CRONTAB_JOURNAL "ssu_crontab_file.journal"	// ssu_crontab_file 이후의 추가, 삭제 기록
+#define CRONTAB_LOCK "ssu_crontab_file.lock"		// ssu_crontab_file 과 저널을 읽고 쓸 때 잠그는 파일
+#define CONTROL_SOCKET "ssu_crond.sock"			// ssu_crond 제어 소켓
+
+#define ARENA_CHUNK_SIZE 65536	// arena 가 한 번에 할당하는 최소 크기
+
+#define LOG_MAX_FILES 4			// 동시에 열어둘 수 있는 로그 파일 수
+#define LOG_RING_SIZE 65536		// 로그 파일별 링 버퍼 크기
+#define LOG_RECORD_MAX 4096		// 로그 한 줄 최대 길이 (넘으면 잘라냄)
+#define LOG_FLUSH_TRIES 100		// log_flush 가 잠금을 잡으려고 시도하는 횟수 (1ms 간격)
 
 #define NUM 0
 #define OP 1
 #define RANGE 2
 
+// 실행 옵션 priority 범위
+#define JOB_PRIORITY_MIN -100
+#define JOB_PRIORITY_MAX 100
+
+// 실행 옵션 jitter 최대값 (실행 시각과 같은 분 안에서만 퍼뜨림)
+#define JOB_JITTER_MAX 59
+
+// 실행 옵션 overlap 값 (이전 실행이 아직 안 끝났을 때 새 실행을 어떻게 할지)
+#define OVERLAP_ALLOW 0			// 그대로 같이 실행
+#define OVERLAP_SKIP 1			// 새 실행을 버림
+#define OVERLAP_QUEUE 2			// 이전 실행이 끝날 때까지 기다렸다가 실행
+#define OVERLAP_KILL 3			// 이전 실행을 종료시키고 실행
+
+// 실행 옵션 catchup 값 (ssu_crond 가 멈춰있던 동안 놓친 실행을 다시 시작할 때 어떻게 할지)
+#define CATCHUP_NONE 0			// 되살리지 않음
+#define CATCHUP_ONCE 1			// 가장 최근에 놓친 실행 하나만 실행
+#define CATCHUP_ALL 2			// catch-up 범위 안에서 놓친 실행을 모두 실행
+
+// 실행 옵션 nice 범위, JOB_NICE_KEEP 이면 ssu_crond 의 nice 를 그대로 물려받음
+#define JOB_NICE_MIN -20
+#define JOB_NICE_MAX 19
+#define JOB_NICE_KEEP 20
+
+// 실행 옵션 ionice 클래스 (커널의 IOPRIO_CLASS_* 와 같은 값) 와 레벨 범위
+#define JOB_IOCLASS_NONE 0
+#define JOB_IOCLASS_RT 1
+#define JOB_IOCLASS_BE 2
+#define JOB_IOCLASS_IDLE 3
+#define JOB_IOLEVEL_MAX 7
+
+// 제어 요청 종류 (ssu_crontab -> ssu_crond)
+#define CTL_ADD 1				// 본문: "분 시 일 월 요일 [옵션] 명령어"
+#define CTL_REMOVE 2			// 본문: "엔트리번호 분 시 일 월 요일 명령어" (CTL_LIST 로 받은 한 줄)
+#define CTL_LIST 3				// 본문 없음, 응답 본문: 엔트리마다 "엔트리번호 분 시 일 월 요일 명령어\n"
+#define CTL_RELOAD 4			// 본문 없음, crontab 파일을 다시 읽게 함
+
+// 제어 응답 종류
+#define CTL_OK 0
+#define CTL_ERROR 255			// 본문: 에러 메시지
+
+// 제어 요청 본문 최대 길이
+#define CTL_MAX_BODY 65536
+
+// ssu_crontab 이 받는 제어 응답 본문 최대 길이 (목록은 엔트리 수에 비례해서 길어짐)
+#define CTL_MAX_REPLY (64 << 20)
+
+// 저널 레코드 종류 (줄의 첫 글자, 뒤에 "엔트리번호 분 시 일 월 요일 명령어" 가 이어짐)
+#define JOURNAL_ADD '+'
+#define JOURNAL_REMOVE '-'
+
+// 저널 첫 줄의 식별 문자열 (형식이 바뀌면 숫자를 올림)
+#define JOURNAL_MAGIC "SSUJ1"
+
+// 저널이 이 크기 (바이트) 를 넘고 ssu_crontab_file 크기의 1/JOURNAL_COMPACT_RATIO 도 넘으면 압축함
+#define JOURNAL_COMPACT_MIN 65536
+#define JOURNAL_COMPACT_RATIO 4
+
+// 다음 실행 시각 탐색 범위 (윤년과 요일이 같은 주기로 돌아오는 28년)
+#define NEXT_FIRE_YEARS 28
+
+// 작은 할당들을 큰 덩어리에서 잘라주고 한 번에 해제하는 메모리 영역
+typedef struct arena_chunk {
+	struct arena_chunk *next;
+	size_t used;
+	size_t size;
+	char data[];
+} arena_chunk;
+
+typedef struct arena {
+	arena_chunk *chunks;
+} arena;
+
+struct crontab;
+
+// 실행 주기 (다섯 필드가 같은 엔트리들은 하나를 공유하므로 주기별로 한 번만 파싱, 검사됨)
+// 문자열들은 테이블의 arena 에 있으며 같은 내용은 하나만 저장됨
+typedef struct schedule {
+	const char *min;
+	const char *hour;
+	const char *day;
+	const char *month;
+	const char *dayofweek;
+
+	// 로드 시 한 번 컴파일된 실행 주기 (비트 i 가 켜져 있으면 값 i 에서 실행)
+	uint64_t min_mask;
+	uint64_t hour_mask;
+	uint64_t day_mask;
+	uint64_t month_mask;
+	uint64_t dow_mask;
+
+	// ssu_crond 스케줄러가 사용하는 상태
+	time_t next_run;	// 다음 실행 시각 (없으면 -1)
+	int heap_idx;		// 스케줄러 힙에서의 위치 (힙에 없으면 -1)
+	struct schedule *inherit;	// reload 시 상태를 물려줄 예전 테이블의 같은 주기 (없으면 NULL)
+
+	struct crontab *jobs;		// 이 주기를 쓰는 엔트리들 (파일 순서, crontab.group_next 로 연결)
+	struct crontab *jobs_tail;
+	int job_count;
+	struct schedule *next;		// 테이블의 주기 리스트
+} schedule;
+
+// 명령어 프로세스를 띄울 때 걸 제한
+typedef struct job_limits {
+	int nice;				// nice 값 (JOB_NICE_KEEP 이면 바꾸지 않음)
+	int ioclass;			// JOB_IOCLASS_* (NONE 이면 바꾸지 않음)
+	int iolevel;			// rt, be 클래스 안의 레벨 (0 이 가장 높음)
+	uint64_t affinity;		// 실행할 수 있는 CPU 비트마스크 (0 이면 바꾸지 않음)
+	unsigned long mem;		// RLIMIT_AS (바이트, 0 이면 바꾸지 않음)
+	unsigned long cpu;		// RLIMIT_CPU (초, 0 이면 바꾸지 않음)
+	int timeout;			// 실행 시작부터 이 시간 (초) 이 지나면 종료시킴 (0 이면 없음)
+} job_limits;
+
+// 명령어 앞에 붙는 실행 옵션 ("[priority=-5 jitter=30 overlap=skip nice=10] 명령어")
+typedef struct job_opts {
+	int priority;		// 클수록 먼저 실행, 0 미만이면 호스트 부하가 높을 때 미뤄질 수 있음
+	int jitter;			// 실행 시각부터 퍼뜨릴 범위 (초, -1 이면 ssu_crond 기본값)
+	int overlap;		// OVERLAP_* (-1 이면 ssu_crond 기본값)
+	int catchup;		// CATCHUP_* (-1 이면 ssu_crond 기본값)
+	job_limits limits;	// 프로세스 제한
+	const char *cmd;	// 옵션 뒤의 실제 명령어 (잘못된 옵션이면 NULL)
+} job_opts;
+
+// crontab 파일의 한 줄
 typedef struct crontab {
-	char min[SM_BUF_SIZE];
-	char hour[SM_BUF_SIZE];
-	char day[SM_BUF_SIZE];
-	char month[SM_BUF_SIZE];
-	char dayofweek[SM_BUF_SIZE];
-	char op[BUF_SIZE];
+	schedule *sched;	// 실행 주기
+	const char *op;		// 명령어 (옵션 포함)
+	const job_opts *opts;	// 실행 옵션 (옵션이 없으면 NULL)
+	struct crontab *group_next;	// 같은 주기를 쓰는 다음 엔트리
 	struct crontab *next, *prev;
+	uint32_t id;		// 저널에서 엔트리를 가리키는 번호 (압축해도 바뀌지 않음)
 } crontab;
 
+// crontab 엔트리들과 그 문자열들을 담는 테이블
+typedef struct crontab_table {
+	crontab head;		// 리스트 헤드 (head.next 부터 엔트리)
+	schedule *scheds;	// 서로 다른 실행 주기 리스트
+	int sched_count;
+	schedule **sched_slots;	// 실행 주기를 내용으로 찾는 해시 테이블 (필요할 때 만듦)
+	size_t sched_size;
+	arena arena;		// 엔트리와 문자열이 할당된 영역
+	int count;			// 파일에서 읽은 엔트리 수
+	uint32_t next_id;	// 새 엔트리에 붙일 번호
+	off_t journal_len;	// 적용한 저널 길이 (저널이 없으면 0)
+	int journal_stale;	// 저널이 지금의 ssu_crontab_file 에 대한 것이 아니면 1 (압축해야 함)
+	void *map;			// 캐시에서 읽은 경우 문자열이 있는 캐시 파일 매핑
+	size_t map_size;
+} crontab_table;
+
+// 서로 다른 실행 주기들의 마스크를 종류별 배열로 모아둔 표 (struct-of-arrays)
+// 여러 주기를 SIMD 로 한 번에 검사할 수 있도록 배열은 32바이트 정렬되고 64의 배수로 채워짐
+typedef struct crontab_columns {
+	uint64_t *min;
+	uint64_t *hour;
+	uint64_t *day;
+	uint64_t *month;
+	uint64_t *dow;
+	uint64_t *active;	// active_key 시각에 시, 일, 월, 요일이 맞는 주기 비트셋
+	size_t words;		// active 의 워드 수
+	long active_key;	// active 를 계산한 시각 (년, 일, 시), 없으면 -1
+	schedule **scheds;	// 인덱스 i 에 해당하는 실행 주기
+	int count;
+} crontab_columns;
+
 typedef struct token {
 	int type;
 	int value;
 } token;
 
-char err_str[BUF_SIZE];
+// 제어 소켓 메시지 헤더 (뒤에 len 바이트의 본문이 이어짐)
+typedef struct ctl_header {
+	uint8_t type;			// CTL_* 요청 또는 응답 종류
+	uint8_t reserved[3];
+	uint32_t len;			// 본문 길이
+} ctl_header;
+
+// 주기 문자열 파싱 결과
+typedef struct term_result {
+	uint64_t mask;			// 실행 가능한 값 i 의 비트가 켜진 마스크
+	int error;				// 잘못된 주기 문자열이면 1
+	int errpos;				// 에러가 발생한 위치 (문자열 인덱스)
+	const char *errmsg;		// 에러 메시지
+} term_result;
+
+extern char err_str[BUF_SIZE];
+extern const char *const overlap_names[];
+extern const char *const catchup_names[];
+
+void *arena_alloc(arena *a, size_t size);
+char *arena_strndup(arena *a, const char *str, size_t len);
+void arena_free(arena *a);
 
-int read_crontab_file(crontab *head);
+void init_crontab_table(crontab_table *table);
+void free_crontab_table(crontab_table *table);
+crontab *new_crontab(crontab_table *table, char *fields[5], const char *op);
+int read_crontab_file(crontab_table *table);
+int read_crontab_file_raw(crontab_table *table);
+long split_crontab_line(const char *p, const char *eol, const char *fields[5], size_t lens[5], const char **op);
+int write_crontab_cache(const crontab_table *table);
+crontab *new_crontab_line(crontab_table *table, const char *line, size_t len);
+crontab *find_crontab(crontab *head, uint32_t id, const char *line);
+int parse_journal_record(const char *p, const char *eol, uint32_t *id, const char **line);
+ssize_t append_crontab_journal(int type, uint32_t id, const char *line, off_t *end);
+int compact_crontab(const crontab_table *table);
+int journal_full(off_t journal_len, off_t file_len);
 int add_crontab(crontab *head, crontab *cp);
 int print_crontab(crontab *cp);
 int remove_crontab(crontab *cp);
 int is_empty_crontab(crontab *head);
 int log_crontab(const char *str);
-int parse_execute_term(const char *exterm, int n);
+int log_printf(const char *path, const char *fmt, ...);
+void log_flush();
+int parse_term(const char *str, term_result *res);
+int parse_execute_term(const char *str, int n);
+int parse_term_mask(const char *str, uint64_t *mask);
+int compile_schedule(schedule *sp);
+int compile_crontab(crontab *cp);
+int parse_job_opts(const char *op, job_opts *opts);
+int parse_name(const char *const names[], const char *val, size_t len);
+int job_limited(const job_limits *lp);
+int match_schedule(const schedule *sp, const struct tm *tm);
+int match_crontab(const crontab *cp, const struct tm *tm);
+int build_crontab_columns(crontab_columns *cols, const crontab_table *table);
+void free_crontab_columns(crontab_columns *cols);
+int due_crontab_columns(crontab_columns *cols, const struct tm *tm, int *idx);
+uint32_t hash_schedule(const schedule *sp);
+int equal_schedule(const schedule *lhs, const schedule *rhs);
+time_t next_fire_time(const schedule *sp, time_t after);
+int ctl_send(int fd, int type, const void *body, uint32_t len);
+int ctl_recv(int fd, ctl_header *hdr, char **body, uint32_t max);
+int ctl_request(const char *path, int type, const void *body, uint32_t len, char **reply);
+int lock_crontab(int type);
+void unlock_crontab(int fd);
 int lock_file(int fd);
+int lock_file_shared(int fd);
 int unlock_file(int fd);
-static int __expr(int n);
 
 #endif
@@ -4,26 +4,88 @@
 #include <string.h>
 #include <memory.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include "core.h"
 
+// simulate 에서 시각 순서대로 출력할 실행 기본 갯수
+#define SIM_LIST_LIMIT 50
+
+// simulate 에서 출력할 가장 바쁜 분 갯수
+#define SIM_TOP_MINUTES 10
+
+// simulate 의 실행 시각 하나 (같은 주기를 쓰는 명령어들이 함께 실행됨)
+typedef struct sim_event {
+	time_t when;			// 실행 시각
+	const schedule *sp;		// 실행 주기
+} sim_event;
+
+// simulate 구간을 나눈 조각
+// 서머타임이 없는 온전한 하루는 마스크만으로 실행 횟수를 셀 수 있고,
+// 나머지 조각은 분마다 마스크 배열(crontab_columns)을 훑어서 셈
+typedef struct sim_segment {
+	time_t start, end;	// [start, end)
+	int whole_day;		// 온전한 하루이면 1
+	int mon, mday, wday;
+} sim_segment;
+
 int print_prompt();
 int parse_input(char *input);
-int process_add(crontab *cp);
+int process_add(char *fields[5], const char *op);
 int process_remove(int num);
+int journal_entry(int type, const crontab *cp);
+int refresh_table();
+void remember_store();
+int same_file(const struct stat *a, const struct stat *b);
+int request_daemon(int type, const void *body, uint32_t len, char **reply);
+int remove_daemon(int num, char **reply);
 int validation_check(const char *term);
+int process_simulate(time_t from, time_t to, int limit);
+int parse_time(const char *str, time_t *t);
+int sim_segments(time_t from, time_t to);
+int sim_columns(long *hist, long *total);
+int job_index(const crontab *cp);
+void sim_push(sim_event ev);
+sim_event sim_pop();
+
+
+crontab_table table;
 
+// 마지막으로 출력한 ssu_crond 의 목록 (엔트리마다 "엔트리번호 분 시 일 월 요일 명령어\n", 없으면 NULL)
+char *daemon_list;
 
-crontab head;
+// table 을 읽었을 때의 ssu_crontab_file 과 저널 (st_ino 가 0 이면 없었음)
+struct stat seen_file, seen_journal;
+
+// simulate 에서 사용하는 구간 조각과 실행 시각 힙
+sim_segment *segs;
+int seg_count;
+sim_event *sim_heap;
+int sim_size;
 
 int main(int argc, char *argv[]) {
 	struct timeval start, end;
-	gettimeofday(&start, NULL);
+	char buf[BUF_SIZE];
+	int len = 0, lfd;
 
-	read_crontab_file(&head);
+	gettimeofday(&start, NULL);
 
-	while (1) {
-		if (print_prompt() < 0)
-			break;
+	// 파일이 없으면 엔트리 번호 1 부터 시작하는 빈 테이블
+	init_crontab_table(&table);
+	table.next_id = 1;
+	lfd = lock_crontab(F_RDLCK);
+	refresh_table();
+	unlock_crontab(lfd);
+
+	if (argc > 1) {
+		// 프롬프트 없이 명령어 하나만 실행 (예: ssu_crontab simulate 02:00 04:00)
+		for (int i = 1; i < argc && len < BUF_SIZE - 1; i++)
+			len += snprintf(buf + len, BUF_SIZE - len, "%s%s", i > 1 ? " " : "", argv[i]);
+		parse_input(buf);
+	} else {
+		while (1) {
+			if (print_prompt() < 0)
+				break;
+		}
 	}
 
 	gettimeofday(&end, NULL);
@@ -44,10 +106,26 @@ int main(int argc, char *argv[]) {
   */
 int print_prompt() {
 	char buf[BUF_SIZE];
-	crontab *node;
-	int i = 0;
-
-	print_crontab(&head);
+	char *list, *p, *eol, *line;
+	int i = 0, lfd;
+
+	// ssu_crond 가 실행 중이면 파일 대신 ssu_crond 의 현재 테이블을 출력
+	// remove 가 출력한 엔트리를 가리킬 수 있도록 엔트리 번호와 함께 기억해 둠
+	free(daemon_list);
+	daemon_list = NULL;
+	if (request_daemon(CTL_LIST, NULL, 0, &list) == 0) {
+		for (p = list; (eol = strchr(p, '\n')) != NULL; p = eol + 1) {
+			line = strchr(p, ' ') + 1;
+			printf("%d. %.*s\n", i++, (int) (eol - line), line);
+		}
+		daemon_list = list;
+	} else {
+		// 다른 ssu_crontab 이 고쳤으면 다시 읽어서 지금의 파일 내용을 보여줌
+		lfd = lock_crontab(F_RDLCK);
+		refresh_table();
+		unlock_crontab(lfd);
+		print_crontab(&table.head);
+	}
 	memset(buf, 0, sizeof(buf));
 	printf("\n%s> ", STD_ID); 
 	fgets(buf, sizeof(buf), stdin);
@@ -66,6 +144,7 @@ int validation_check(const char *term) {
 	char *str = "1234567890*-,/";
 	int is_matched;
 	const char *tmp = term;
+	term_result res;
 
 	while (*term != '\0') {
 		is_matched = 0;
@@ -81,8 +160,10 @@ int validation_check(const char *term) {
 		term++;
 	}
 
-	if (parse_execute_term(tmp, -1) == -1) 
+	if (parse_term(tmp, &res) < 0) {
+		fprintf(stderr, "%s\n%*s^ %s\n", tmp, res.errpos, "", res.errmsg);
 		return 0;
+	}
 	return 1;
 }
 
@@ -92,8 +173,12 @@ int validation_check(const char *term) {
   @return 성공 시 0 에러 시 -1
   */
 int parse_input(char *input) {
-	char *p;
-	crontab *crontab_node;
+	char *p, *reply;
+	char *fields[5];
+	char line[BUF_SIZE];
+	job_opts opts;
+	uint32_t len;
+	int ret, lfd;
 
 	if (!strncmp(input, "exit", 4)) {
 		return 1;
@@ -104,52 +189,15 @@ int parse_input(char *input) {
 		return -1;
 
 	if (!strcmp(p, "add")) {
-		crontab_node = calloc(1, sizeof(crontab));
-
-		// min
-		p = strtok(NULL, " ");
-		if (p == NULL || !validation_check(p)) {
-			fprintf(stderr, "add input error\n");
-			free(crontab_node);
-			return -1;
-		}
-		strcpy(crontab_node->min, p);
-
-		// hour
-		p = strtok(NULL, " ");
-		if (p == NULL || !validation_check(p)) {
-			fprintf(stderr, "add input error\n");
-			free(crontab_node);
-			return -1;
-		}
-		strcpy(crontab_node->hour, p);
-
-		// day
-		p = strtok(NULL, " ");
-		if (p == NULL || !validation_check(p)) {
-			fprintf(stderr, "add input error\n");
-			free(crontab_node);
-			return -1;
-		}
-		strcpy(crontab_node->day, p);
-
-		// month
-		p = strtok(NULL, " ");
-		if (p == NULL || !validation_check(p)) {
-			fprintf(stderr, "add input error\n");
-			free(crontab_node);
-			return -1;
-		}
-		strcpy(crontab_node->month, p);
-
-		// dayofweek
-		p = strtok(NULL, " ");
-		if (p == NULL || !validation_check(p)) {
-			fprintf(stderr, "add input error\n");
-			free(crontab_node);
-			return -1;
+		// min, hour, day, month, dayofweek
+		for (int i = 0; i < 5; i++) {
+			p = strtok(NULL, " ");
+			if (p == NULL || !validation_check(p)) {
+				fprintf(stderr, "add input error\n");
+				return -1;
+			}
+			fields[i] = p;
 		}
-		strcpy(crontab_node->dayofweek, p);
 
 		p += strlen(p) + 1;
 		while (*p == ' ')
@@ -158,12 +206,25 @@ int parse_input(char *input) {
 		// op
 		if (*p == '\0') {
 			fprintf(stderr, "add input error\n");
-			free(crontab_node);
 			return -1;
 		}
 
-		strcpy(crontab_node->op, p);
-		if (process_add(crontab_node) < 0)
+		// 명령어 앞의 실행 옵션 ([priority=-5] 명령어)
+		if (parse_job_opts(p, &opts) < 0) {
+			fprintf(stderr, "add input error: %s", err_str);
+			return -1;
+		}
+
+		// ssu_crond 가 실행 중이면 ssu_crond 가 테이블과 파일에 바로 반영함
+		len = snprintf(line, sizeof(line), "%s %s %s %s %s %s", fields[0], fields[1], fields[2],
+				fields[3], fields[4], p);
+		// 로컬 테이블은 필요할 때 (simulate, 목록 출력) 저장된 내용으로 다시 읽음
+		if ((ret = request_daemon(CTL_ADD, line, len, NULL)) > 0)
+			return -1;
+		if (ret == 0)
+			return 0;
+
+		if (process_add(fields, p) < 0)
 			return -1;
 		return 0;
 	} else if (!strcmp(p, "remove")) {
@@ -174,8 +235,41 @@ int parse_input(char *input) {
 		}
 
 		int num = atoi(p);
+
+		// 번호는 ssu_crond 가 출력한 목록 기준, 그 사이에 바뀌었으면 ssu_crond 가 거절함
+		if ((ret = remove_daemon(num, &reply)) >= 0) {
+			free(reply);
+			return ret == 0 ? 0 : -1;
+		}
+
 		if (process_remove(num) < 0)
 			return -1;
+	} else if (!strcmp(p, "reload")) {
+		if ((ret = request_daemon(CTL_RELOAD, NULL, 0, NULL)) < 0)
+			fprintf(stderr, "%s", err_str);
+		return ret == 0 ? 0 : -1;
+	} else if (!strcmp(p, "simulate")) {
+		char *from, *to;
+		time_t t1, t2;
+		int limit = SIM_LIST_LIMIT;
+
+		from = strtok(NULL, " ");
+		to = strtok(NULL, " ");
+		if ((p = strtok(NULL, " ")) != NULL)
+			limit = atoi(p);
+
+		if (from == NULL || to == NULL || parse_time(from, &t1) < 0 || parse_time(to, &t2) < 0
+				|| t1 >= t2 || limit < 0) {
+			fprintf(stderr, "usage: simulate <from> <to> [limit]\n"
+					"  time: YYYY-MM-DDTHH:MM, YYYY-MM-DD, HH:MM (today), now\n");
+			return -1;
+		}
+
+		// ssu_crond 나 다른 ssu_crontab 이 고쳤을 수 있으므로 저장된 내용으로 다시 읽음
+		lfd = lock_crontab(F_RDLCK);
+		refresh_table();
+		unlock_crontab(lfd);
+		return process_simulate(t1, t2, limit);
 	}
 
 	return -1;
@@ -183,45 +277,62 @@ int parse_input(char *input) {
 
 /**
   add 명령을 처리하는 함수
-  @param cp add할 crontab 포인터
-  @return
+  파일을 다시 쓰지 않고 저널에 한 줄만 붙임
+  다른 ssu_crontab 과 엔트리 번호가 겹치지 않도록 잠근 뒤 최신 테이블에 추가함
+  @param fields 분, 시, 일, 월, 요일
+  @param op 명령어
+  @return 성공 시 0, 에러 시 -1
   */
-int process_add(crontab *cp) {
-	FILE *fp;
+int process_add(char *fields[5], const char *op) {
+	crontab *cp;
 	char buf[BUFSIZ];
+	int lfd;
 
-	if ((fp = fopen(CRONTAB_FILE, "a+")) == NULL) {
-		fprintf(stderr, "fopen error for %s\n", CRONTAB_FILE);
+	if ((lfd = lock_crontab(F_WRLCK)) < 0) {
+		fprintf(stderr, "%s", err_str);
 		return -1;
 	}
+	refresh_table();
 
-	if (add_crontab(&head, cp) < 0) {
+	cp = new_crontab(&table, fields, op);
+	compile_crontab(cp);
+	if (add_crontab(&table.head, cp) < 0) {
+		unlock_crontab(lfd);
 		fprintf(stderr, "add_crontab error\n");
-		fclose(fp);
 		return -1;
 	}
+	cp->id = table.next_id++;
+	table.count++;
 
-	fprintf(fp, "%s %s %s %s %s %s\n", cp->min, cp->hour, cp->day, cp->month, cp->dayofweek, cp->op);
-
-	fclose(fp);
+	if (journal_entry(JOURNAL_ADD, cp) < 0) {
+		remove_crontab(cp);
+		table.count--;
+		unlock_crontab(lfd);
+		return -1;
+	}
+	remember_store();
+	unlock_crontab(lfd);
 
-	sprintf(buf, "add %s %s %s %s %s %s\n", cp->min, cp->hour, cp->day, cp->month, cp->dayofweek, cp->op);
+	sprintf(buf, "add %s %s %s %s %s %s\n", cp->sched->min, cp->sched->hour, cp->sched->day,
+			cp->sched->month, cp->sched->dayofweek, cp->op);
 	log_crontab(buf);
 	return 0;
 }
 
 /**
   remove 명령을 처리하는 함수
+  파일을 다시 쓰지 않고 저널에 한 줄만 붙임
+  번호는 마지막으로 출력한 목록 기준이므로, 그 사이에 다른 ssu_crontab 이 고쳤으면 같은 엔트리를 최신 테이블에서 다시 찾음
   @param num 삭제 할 명령의 인덱스
   @return
   */
 int process_remove(int num) {
-	crontab *tmp;
-	crontab *cpy;
-	FILE *fp;
-	char buf[BUFSIZ];
+	crontab *tmp, *cpy;
+	char buf[BUFSIZ], *line;
+	uint32_t id;
+	int lfd;
 
-	tmp = &head;
+	tmp = &table.head;
 	for (int i = 0; i <= num; i++) {
 		if (tmp->next == NULL) {
 			printf("잘못된 번호 입니다.\n");
@@ -231,40 +342,498 @@ int process_remove(int num) {
 		tmp = tmp->next;
 	}
 
-	// 노드 삭제 도중 에러 발생 시 복구시키기 위함
-	cpy = calloc(1, sizeof(crontab));
-	strcpy(cpy->min, tmp->min);
-	strcpy(cpy->hour, tmp->hour);
-	strcpy(cpy->day, tmp->day);
-	strcpy(cpy->month, tmp->month);
-	strcpy(cpy->dayofweek, tmp->dayofweek);
-	strcpy(cpy->op, tmp->op);
+	if ((lfd = lock_crontab(F_WRLCK)) < 0) {
+		fprintf(stderr, "%s", err_str);
+		return -1;
+	}
+
+	if (refresh_table()) {
+		snprintf(buf, sizeof(buf), "%s %s %s %s %s %s", tmp->sched->min, tmp->sched->hour, tmp->sched->day,
+				tmp->sched->month, tmp->sched->dayofweek, tmp->op);
+		line = strdup(buf);
+		id = tmp->id;
+
+		// 예전 테이블은 해제되었으므로 복사해둔 번호와 내용으로 찾음
+		tmp = find_crontab(&table.head, id, line);
+		free(line);
+		if (tmp == NULL) {
+			unlock_crontab(lfd);
+			printf("이미 삭제된 항목 입니다.\n");
+			return 1;
+		}
+	}
 
+	// 리스트에서 빠진 노드도 테이블을 해제하기 전까지는 유효하므로 복구에 사용
+	cpy = tmp;
 	if (remove_crontab(tmp) < 0) {
-		free(cpy);
+		unlock_crontab(lfd);
 		return -1;
 	}
+	table.count--;
 
-	// 파일 재작성
-	if ((fp = fopen(CRONTAB_FILE, "w")) == NULL) {
-		fprintf(stderr, "fopen error for %s\n", CRONTAB_FILE);
-
+	if (journal_entry(JOURNAL_REMOVE, cpy) < 0) {
 		// 파일 적용에 실패하면 다시 리스트에 복귀시킴
-		add_crontab(&head, cpy);
+		add_crontab(&table.head, cpy);
+		table.count++;
+		unlock_crontab(lfd);
 		return -1;
 	}
+	remember_store();
+	unlock_crontab(lfd);
 
-	tmp = head.next;
-	while (tmp != NULL) {
-		fprintf(fp, "%s %s %s %s %s %s\n", tmp->min, tmp->hour, tmp->day, tmp->month, tmp->dayofweek, tmp->op);
-		tmp = tmp->next;
+	sprintf(buf, "remove %s %s %s %s %s %s\n", cpy->sched->min, cpy->sched->hour, cpy->sched->day,
+			cpy->sched->month, cpy->sched->dayofweek, cpy->op);
+	log_crontab(buf);
+	return 0;
+}
+
+/**
+  add, remove 를 저널에 기록하는 함수
+  저널이 없거나 손으로 고친 ssu_crontab_file 에 대한 것이면, 또는 저널이 충분히 커졌으면 테이블 전체로 압축함
+  @param type JOURNAL_ADD 또는 JOURNAL_REMOVE
+  @param cp 추가하거나 지운 엔트리 (테이블에는 이미 반영되어 있어야 함)
+  저널에 붙인 뒤에는 이미 반영된 것이므로 압축에 실패해도 에러를 출력만 하고 성공으로 처리함 (다음 쓰기 때 다시 압축)
+  @return 성공 시 0, 에러 시 -1
+  */
+int journal_entry(int type, const crontab *cp) {
+	struct stat statbuf;
+	char *line;
+	off_t end;
+	ssize_t n = 0;
+	int len;
+
+	if (!table.journal_stale) {
+		len = snprintf(NULL, 0, "%s %s %s %s %s %s", cp->sched->min, cp->sched->hour, cp->sched->day,
+				cp->sched->month, cp->sched->dayofweek, cp->op);
+		line = malloc(len + 1);
+		sprintf(line, "%s %s %s %s %s %s", cp->sched->min, cp->sched->hour, cp->sched->day,
+				cp->sched->month, cp->sched->dayofweek, cp->op);
+		n = append_crontab_journal(type, cp->id, line, &end);
+		free(line);
+
+		if (n < 0) {
+			fprintf(stderr, "%s", err_str);
+			return -1;
+		}
+		if (n > 0 && (stat(CRONTAB_FILE, &statbuf) < 0 || !journal_full(end, statbuf.st_size)))
+			return 0;
+	}
+
+	if (compact_crontab(&table) < 0) {
+		fprintf(stderr, "%s", err_str);
+		return n > 0 ? 0 : -1;
 	}
+	table.journal_stale = 0;
+	return 0;
+}
 
-	fclose(fp);
+/**
+  다른 프로세스가 ssu_crontab_file 이나 저널을 바꿨으면 테이블을 다시 읽는 함수
+  읽는 동안 바뀌지 않도록 lock_crontab 을 잡은 채로 불러야 함
+  @return 다시 읽었으면 1 아니면 0
+  */
+int refresh_table() {
+	struct stat fs, js;
+
+	if (stat(CRONTAB_FILE, &fs) < 0)
+		memset(&fs, 0, sizeof(fs));
+	if (stat(CRONTAB_JOURNAL, &js) < 0)
+		memset(&js, 0, sizeof(js));
+	if (same_file(&fs, &seen_file) && same_file(&js, &seen_journal))
+		return 0;
 
-	sprintf(buf, "remove %s %s %s %s %s %s\n", cpy->min, cpy->hour, cpy->day, cpy->month, cpy->dayofweek, cpy->op);
-	log_crontab(buf);
-	free(cpy);
-	cpy = NULL;
+	// 파일이 없으면 빈 테이블에서 시작
+	free_crontab_table(&table);
+	if (read_crontab_file(&table) < 0) {
+		free_crontab_table(&table);
+		table.next_id = 1;
+	}
+	remember_store();
+	return 1;
+}
+
+/**
+  ssu_crontab_file 과 저널의 지금 상태를 테이블을 읽은 상태로 기록하는 함수
+  이 프로세스가 쓴 뒤에 불러서 자기가 쓴 것 때문에 다시 읽지 않도록 함
+  */
+void remember_store() {
+	if (stat(CRONTAB_FILE, &seen_file) < 0)
+		memset(&seen_file, 0, sizeof(seen_file));
+	if (stat(CRONTAB_JOURNAL, &seen_journal) < 0)
+		memset(&seen_journal, 0, sizeof(seen_journal));
+}
+
+/**
+  두 stat 이 같은 파일의 같은 내용인지 확인하는 함수 (둘 다 st_ino 가 0 이면 둘 다 없는 것)
+  @return 같으면 1 아니면 0
+  */
+int same_file(const struct stat *a, const struct stat *b) {
+	return a->st_ino == b->st_ino && a->st_size == b->st_size
+		&& a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/**
+  실행 중인 ssu_crond 에 제어 요청을 보내는 함수
+  @param type CTL_* 요청 종류
+  @param body 요청 본문
+  @param len 요청 본문 길이
+  @param reply 성공 시 응답 본문 저장 (새로 할당, NULL 이면 버림)
+  @return 성공 시 0, ssu_crond 가 거절하면 에러를 출력하고 1, ssu_crond 가 실행 중이 아니면 -1 리턴하고 err_str 설정
+  */
+int request_daemon(int type, const void *body, uint32_t len, char **reply) {
+	char *buf;
+	int ret;
+
+	if (reply != NULL)
+		*reply = NULL;
+	if ((ret = ctl_request(CONTROL_SOCKET, type, body, len, &buf)) < 0)
+		return -1;
+
+	if (ret != CTL_OK) {
+		fprintf(stderr, "%s", buf != NULL ? buf : err_str);
+		free(buf);
+		return 1;
+	}
+
+	if (reply != NULL)
+		*reply = buf;
+	else
+		free(buf);
+	return 0;
+}
+
+/**
+  마지막으로 출력한 ssu_crond 의 목록에서 num 번째 엔트리를 지우도록 요청하는 함수
+  엔트리 번호와 내용을 함께 보내므로 목록을 출력한 뒤에 바뀐 엔트리는 지워지지 않음
+  @param num 목록에서의 번호
+  @param reply 성공 시 지운 엔트리 "분 시 일 월 요일 명령어" 저장 (새로 할당)
+  @return request_daemon 과 같음
+  */
+int remove_daemon(int num, char **reply) {
+	char *p, *eol;
+	int ret;
+
+	*reply = NULL;
+
+	// 프롬프트 없이 실행한 경우는 목록을 먼저 받음
+	if (daemon_list == NULL && (ret = request_daemon(CTL_LIST, NULL, 0, &daemon_list)) != 0)
+		return ret;
+
+	for (p = daemon_list; (eol = strchr(p, '\n')) != NULL && num > 0; p = eol + 1)
+		num--;
+	if (num < 0 || eol == NULL) {
+		printf("잘못된 번호 입니다.\n");
+		return 1;
+	}
+	return request_daemon(CTL_REMOVE, p, eol - p, reply);
+}
+
+/**
+  simulate 명령을 처리하는 함수
+  [from, to) 구간에 실행될 명령어들을 시각 순서대로 limit 개까지 출력하고,
+  구간 전체의 실행 횟수를 하루 중 분 단위 히스토그램으로 출력함
+  목록은 노드별 다음 실행 시각을 힙으로 합쳐서 만들고,
+  횟수는 온전한 하루는 마스크 비트 수로, 나머지는 분마다 마스크 배열을 훑어서 셈
+  @param from 구간 시작 시각
+  @param to 구간 끝 시각 (포함하지 않음)
+  @param limit 출력할 실행 갯수
+  @return 성공 시 0, 에러 시 -1
+  */
+int process_simulate(time_t from, time_t to, int limit) {
+	static long hist[24 * 60];
+	char when[SM_BUF_SIZE];
+	struct tm tm;
+	const schedule *sp;
+	const crontab *cp;
+	sim_event ev;
+	long total = 0, days;
+	int shown = 0, hours, mins, top[SIM_TOP_MINUTES];
+	time_t t;
+
+	// TZ 가 없으면 glibc 는 mktime 마다 /etc/localtime 을 다시 확인하므로
+	// 수많은 next_fire_time 호출이 시스템 콜 비용이 되지 않도록 고정함
+	if (getenv("TZ") == NULL)
+		setenv("TZ", ":/etc/localtime", 0);
+
+	if (sim_segments(from, to) < 0)
+		return -1;
+	memset(hist, 0, sizeof(hist));
+
+	sim_heap = malloc(sizeof(sim_event) * (table.sched_count + 1));
+	sim_size = 0;
+
+	// 같은 주기를 쓰는 명령어들은 주기마다 한 번만 계산하고 명령어 수를 곱함
+	for (sp = table.scheds; sp != NULL; sp = sp->next) {
+		if (sp->job_count == 0)
+			continue;
+
+		// 목록용 첫 실행 시각
+		if (limit > 0 && (t = next_fire_time(sp, from - 1)) >= 0 && t < to)
+			sim_push((sim_event) { t, sp });
+
+		// 온전한 하루들의 실행 횟수
+		days = 0;
+		for (int i = 0; i < seg_count; i++) {
+			if (segs[i].whole_day)
+				days += (sp->month_mask >> segs[i].mon & 1) && (sp->day_mask >> segs[i].mday & 1)
+					&& (sp->dow_mask >> segs[i].wday & 1);
+		}
+		days *= sp->job_count;
+
+		// 실행되는 온전한 하루마다 켜진 시, 분 비트 조합에서 한 번씩 실행됨
+		if (days > 0) {
+			hours = __builtin_popcountll(sp->hour_mask & ((1ULL << 24) - 1));
+			mins = __builtin_popcountll(sp->min_mask & ((1ULL << 60) - 1));
+			for (int h = 0; h < 24; h++) {
+				if (!(sp->hour_mask >> h & 1))
+					continue;
+				for (int m = 0; m < 60; m++) {
+					if (sp->min_mask >> m & 1)
+						hist[h * 60 + m] += days;
+				}
+			}
+			total += days * hours * mins;
+		}
+	}
+
+	// 나머지 조각은 분마다 마스크 배열을 훑어서 셈
+	if (sim_columns(hist, &total) < 0)
+		return -1;
+
+	// 시각 순서대로 limit 개 출력
+	while (sim_size > 0 && shown < limit) {
+		ev = sim_pop();
+		localtime_r(&ev.when, &tm);
+		strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm);
+		for (cp = ev.sp->jobs; cp != NULL && shown < limit; cp = cp->group_next, shown++)
+			printf("%s  %d. %s %s %s %s %s %s\n", when, job_index(cp), ev.sp->min, ev.sp->hour,
+					ev.sp->day, ev.sp->month, ev.sp->dayofweek, cp->op);
+
+		if ((ev.when = next_fire_time(ev.sp, ev.when)) >= 0 && ev.when < to)
+			sim_push(ev);
+	}
+	free(sim_heap);
+	free(segs);
+
+	if (total > shown)
+		printf("... %ld more\n", total - shown);
+	printf("\n%ld runs in total\n", total);
+	if (total == 0)
+		return 0;
+
+	// 가장 바쁜 분 (같으면 이른 시각 우선)
+	printf("\nbusiest minutes of the day:\n");
+	for (int k = 0; k < SIM_TOP_MINUTES; k++) {
+		top[k] = -1;
+		for (int i = 0; i < 24 * 60; i++) {
+			int used = 0;
+
+			for (int j = 0; j < k; j++)
+				used |= top[j] == i;
+			if (!used && hist[i] > 0 && (top[k] < 0 || hist[i] > hist[top[k]]))
+				top[k] = i;
+		}
+		if (top[k] < 0)
+			break;
+		printf("  %02d:%02d %ld\n", top[k] / 60, top[k] % 60, hist[top[k]]);
+	}
+
+	printf("\nruns per hour:\n");
+	for (int h = 0; h < 24; h++) {
+		long sum = 0;
+
+		for (int m = 0; m < 60; m++)
+			sum += hist[h * 60 + m];
+		if (sum > 0)
+			printf("  %02d:00 %ld\n", h, sum);
+	}
+	return 0;
+}
+
+/**
+  시각 문자열을 time_t 로 바꾸는 함수
+  YYYY-MM-DDTHH:MM, YYYY-MM-DD, HH:MM (오늘), now 를 지원함
+  @param str 시각 문자열
+  @param t 결과를 저장
+  @return 성공 시 0, 에러 시 -1
+  */
+int parse_time(const char *str, time_t *t) {
+	struct tm tm;
+	time_t now = time(NULL);
+	int year, mon, day, hour = 0, min = 0, len = -1;
+
+	localtime_r(&now, &tm);
+	tm.tm_sec = 0;
+
+	if (!strcmp(str, "now")) {
+		*t = now / 60 * 60;
+		return 0;
+	}
+
+	if (sscanf(str, "%d-%d-%dT%d:%d%n", &year, &mon, &day, &hour, &min, &len) == 5 && str[len] == '\0') {
+	} else if (len = -1, sscanf(str, "%d-%d-%d%n", &year, &mon, &day, &len) == 3 && str[len] == '\0') {
+		hour = min = 0;
+	} else if (len = -1, sscanf(str, "%d:%d%n", &hour, &min, &len) == 2 && str[len] == '\0') {
+		year = tm.tm_year + 1900;
+		mon = tm.tm_mon + 1;
+		day = tm.tm_mday;
+	} else {
+		return -1;
+	}
+
+	if (mon < 1 || mon > 12 || day < 1 || day > 31 || hour < 0 || hour > 23 || min < 0 || min > 59)
+		return -1;
+
+	tm.tm_year = year - 1900;
+	tm.tm_mon = mon - 1;
+	tm.tm_mday = day;
+	tm.tm_hour = hour;
+	tm.tm_min = min;
+	tm.tm_isdst = -1;
+	if ((*t = mktime(&tm)) < 0)
+		return -1;
+	return 0;
+}
+
+/**
+  [from, to) 구간을 온전한 하루들과 나머지 조각들로 나누는 함수
+  결과는 segs, seg_count 에 저장됨
+  @return 성공 시 0, 에러 시 -1
+  */
+int sim_segments(time_t from, time_t to) {
+	struct tm tm;
+	time_t start, next;
+	int cap = 16;
+
+	segs = malloc(sizeof(sim_segment) * cap);
+	seg_count = 0;
+
+	// from 이후 처음 시작하는 하루
+	localtime_r(&from, &tm);
+	if (tm.tm_hour != 0 || tm.tm_min != 0 || tm.tm_sec != 0)
+		tm.tm_mday++;
+	tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+	tm.tm_isdst = -1;
+	start = mktime(&tm);
+
+	if (start > from)
+		segs[seg_count++] = (sim_segment) { .start = from, .end = start < to ? start : to };
+
+	while (start < to) {
+		tm.tm_mday++;
+		tm.tm_isdst = -1;
+		next = mktime(&tm);
+
+		if (seg_count + 1 >= cap) {
+			cap *= 2;
+			segs = realloc(segs, sizeof(sim_segment) * cap);
+		}
+
+		if (next <= to && next - start == 24 * 60 * 60) {
+			localtime_r(&start, &tm);
+			segs[seg_count++] = (sim_segment) { .start = start, .end = next, .whole_day = 1,
+					.mon = tm.tm_mon + 1, .mday = tm.tm_mday, .wday = tm.tm_wday };
+		} else if (seg_count > 0 && !segs[seg_count - 1].whole_day && segs[seg_count - 1].end == start) {
+			// 서머타임이 바뀌는 날이나 구간 끝의 조각은 앞 조각과 합침
+			segs[seg_count - 1].end = next < to ? next : to;
+		} else {
+			segs[seg_count++] = (sim_segment) { .start = start, .end = next < to ? next : to };
+		}
+
+		start = next;
+		localtime_r(&start, &tm);
+	}
+
+	return 0;
+}
+
+/**
+  온전한 하루가 아닌 조각들의 실행 횟수를 분마다 마스크 배열을 훑어서 세는 함수
+  서머타임이 끝나 같은 시각이 반복되는 동안은 next_fire_time 처럼 한 번만 셈
+  @param hist 하루 중 분별 실행 횟수에 더함
+  @param total 전체 실행 횟수에 더함
+  @return 성공 시 0, 에러 시 -1
+  */
+int sim_columns(long *hist, long *total) {
+	crontab_columns cols;
+	struct tm tm;
+	long key, last = -1;
+	int *idx, due, partial = 0;
+
+	for (int i = 0; i < seg_count; i++)
+		partial |= !segs[i].whole_day;
+	if (!partial)
+		return 0;
+
+	if (build_crontab_columns(&cols, &table) < 0) {
+		fprintf(stderr, "%s", err_str);
+		return -1;
+	}
+	idx = malloc(sizeof(int) * (cols.count + 1));
+
+	for (int i = 0; i < seg_count; i++) {
+		if (segs[i].whole_day)
+			continue;
+
+		for (time_t t = segs[i].start; t < segs[i].end; t += 60) {
+			localtime_r(&t, &tm);
+			key = (((long) tm.tm_year * 400 + tm.tm_yday) * 24 + tm.tm_hour) * 60 + tm.tm_min;
+			if (key <= last)
+				continue;
+			last = key;
+
+			due = 0;
+			for (int k = due_crontab_columns(&cols, &tm, idx) - 1; k >= 0; k--)
+				due += cols.scheds[idx[k]]->job_count;
+			hist[tm.tm_hour * 60 + tm.tm_min] += due;
+			*total += due;
+		}
+	}
+
+	free(idx);
+	free_crontab_columns(&cols);
 	return 0;
 }
+
+/**
+  엔트리의 리스트에서의 번호를 구하는 함수 (print_crontab 의 번호와 같음)
+  */
+int job_index(const crontab *cp) {
+	int idx = -1;
+
+	for (; cp != &table.head; cp = cp->prev)
+		idx++;
+	return idx;
+}
+
+/**
+  simulate 실행 시각 힙에 실행을 넣는 함수
+  */
+void sim_push(sim_event ev) {
+	int i = sim_size++;
+
+	while (i > 0 && sim_heap[(i - 1) / 2].when > ev.when) {
+		sim_heap[i] = sim_heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	sim_heap[i] = ev;
+}
+
+/**
+  simulate 실행 시각 힙에서 가장 이른 실행을 꺼내는 함수
+  */
+sim_event sim_pop() {
+	sim_event top = sim_heap[0], last = sim_heap[--sim_size];
+	int i = 0, child;
+
+	while ((child = 2 * i + 1) < sim_size) {
+		if (child + 1 < sim_size && sim_heap[child + 1].when < sim_heap[child].when)
+			child++;
+		if (last.when <= sim_heap[child].when)
+			break;
+		sim_heap[i] = sim_heap[child];
+		i = child;
+	}
+	sim_heap[i] = last;
+	return top;
+}
@@ -1,59 +1,747 @@
+// sched_setaffinity, CPU_SET, pipe2
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <time.h>
 #include <syslog.h>
 #include <signal.h>
 #include <fcntl.h>
-#include "core.h"
+#include <poll.h>
+#include <spawn.h>
+#include <errno.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include "core.h"
+#include "daemon.h"
+#include "metrics.h"
+#include "state.h"
+#include "control.h"
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sched.h>
+
+#define USAGE "usage: ssu_crond [-j max_jobs] [-c catchup_minutes] [-m metrics_file]\n" \
+		"                 [-l max_load_per_cpu] [-p max_memory_pressure] [-b defer_budget_sec]\n" \
+		"                 [-J jitter_sec] [-o allow|skip|queue|kill] [-s state_file]\n" \
+		"                 [-C none|once|all] [-u control_socket]\n"
+
+// 이 문자들이 들어간 명령어는 셸을 거쳐서 실행
+#define SHELL_META "|&;<>()$`\\\"'*?[]#~{}!\n"
+
+/**
+  기본 시계, 시스템 시각을 그대로 사용
+  */
+static int __realtime_clock(struct timespec *ts) {
+	return clock_gettime(CLOCK_REALTIME, ts);
+}
+
+// 스케줄러의 현재 테이블 (파일을 읽기 전에 제어 소켓으로 추가한 엔트리는 번호 1 부터)
+crontab_table table = { .next_id = 1 };
+
+// 제어 요청으로 스케줄러가 현재 테이블의 리스트와 주기 목록을 바꾸는 동안
+// reload 스레드가 현재 테이블을 읽지 않도록 막는 잠금 (그 외의 스케줄러 작업은 잠그지 않음)
+pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+extern char **environ;
+
+// 실행 대기 큐와 실행 중인 명령어 리스트
+static int pending_before(const job_run *a, const job_run *b);
+static int delayed_before(const job_run *a, const job_run *b);
+static int expiring_before(const job_run *a, const job_run *b);
+job_queue pending = { .before = pending_before };
+job_run running;
+int running_count;
+int max_jobs = DEFAULT_MAX_JOBS;
+int catchup_window = DEFAULT_CATCHUP;
+
+// 실행 시각이 되었지만 지터만큼 기다리는 명령어들 (풀려날 시각 기준 힙)
+job_queue delayed = { .before = delayed_before };
+
+// timeout 이 있는 실행 중인 명령어들 (시그널을 보낼 시각 기준 힙)
+job_queue expiring = { .before = expiring_before };
+
+// 옵션으로 지터를 정하지 않은 명령어의 지터 범위 (초, 0 이면 바로 실행)
+int default_jitter;
+
+// 옵션으로 겹침 정책을 정하지 않은 명령어의 정책 (OVERLAP_*)
+int default_overlap = OVERLAP_ALLOW;
+
+// 옵션으로 catch-up 정책을 정하지 않은 명령어의 정책 (CATCHUP_*)
+int default_catchup = CATCHUP_ONCE;
+
+// overlap=queue 로 이전 실행이 끝나길 기다리는 명령어 수
+int held_count;
+
+// 우선순위가 0 미만인 명령어의 실행을 미루는 호스트 부하 한도 (0 이면 보지 않음)
+double max_load;			// CPU 하나당 1분 평균 load
+double max_mem_pressure;	// 메모리 PSI some avg10 (%)
+int defer_budget = DEFAULT_DEFER_BUDGET;
+
+// 마지막으로 읽은 호스트 부하
+double host_load;
+double host_mem_pressure;
+
+// 미뤄둔 명령어가 있을 때 다시 확인할 시각 (없으면 0)
+time_t admit_retry;
+
+// 실행 시각 판단에 쓰는 시계 (부하 테스트에서는 가상 시계로 바꿔 끼움)
+int (*daemon_clock)(struct timespec *ts) = __realtime_clock;
+
+// 명령어가 실행될 때마다 불리는 함수 (없으면 NULL)
+void (*launch_hook)(const job_run *run);
+
+// 다음 실행 시각 기준 실행 주기 최소 힙
+schedule **heap;
+int heap_size;
+int heap_cap;
+
+// reload 스레드가 스케줄러에 넘길 새 테이블 (스케줄러가 가져가면 NULL)
+static table_snapshot *_Atomic published;
+
+// 스케줄러가 놓은 예전 테이블들 (reload 스레드가 해제)
+static table_snapshot *_Atomic retired;
+
+// 스케줄러가 정지 상태 (루프 맨 앞) 를 지날 때마다 증가
+static _Atomic unsigned long sched_epoch;
+
+// 새 테이블이 있음을 스케줄러에 알리는 eventfd, 스케줄러가 테이블을 가져갔음을 알리는 eventfd
+static int wake_fd, adopt_fd;
+
+/**
+  daemon_clock 기준 현재 시각을 초 단위로 구하는 함수
+  */
+time_t daemon_time() {
+	struct timespec ts;
+
+	daemon_clock(&ts);
+	return ts.tv_sec;
+}
+
+/**
+  힙의 두 원소를 바꾸는 함수
+  */
+static void heap_swap(int i, int j) {
+	schedule *tmp = heap[i];
+
+	heap[i] = heap[j];
+	heap[j] = tmp;
+	heap[i]->heap_idx = i;
+	heap[j]->heap_idx = j;
+}
+
+/**
+  i 번째 원소를 위로 올리는 함수
+  */
+static void heap_sift_up(int i) {
+	while (i > 0 && heap[(i - 1) / 2]->next_run > heap[i]->next_run) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+/**
+  i 번째 원소를 아래로 내리는 함수
+  */
+static void heap_sift_down(int i) {
+	int child;
+
+	while ((child = 2 * i + 1) < heap_size) {
+		if (child + 1 < heap_size && heap[child + 1]->next_run < heap[child]->next_run)
+			child++;
+		if (heap[i]->next_run <= heap[child]->next_run)
+			break;
+		heap_swap(i, child);
+		i = child;
+	}
+}
+
+/**
+  힙에 실행 주기를 추가하는 함수
+  @param sp 추가할 실행 주기 (next_run 이 설정되어 있어야 함)
+  */
+void heap_push(schedule *sp) {
+	if (heap_size == heap_cap) {
+		heap_cap = heap_cap ? heap_cap * 2 : 64;
+		heap = realloc(heap, heap_cap * sizeof(schedule *));
+	}
+
+	heap[heap_size] = sp;
+	sp->heap_idx = heap_size++;
+	heap_sift_up(sp->heap_idx);
+}
+
+/**
+  힙에서 가장 먼저 실행될 실행 주기를 꺼내는 함수
+  @return 꺼낸 실행 주기, 힙이 비어있으면 NULL
+  */
+schedule *heap_pop() {
+	schedule *sp;
+
+	if (heap_size == 0)
+		return NULL;
+
+	sp = heap[0];
+	heap_swap(0, --heap_size);
+	heap_sift_down(0);
+	sp->heap_idx = -1;
+	return sp;
+}
+
+/**
+  힙의 중간에 있는 실행 주기를 빼는 함수
+  @param sp 뺄 실행 주기 (힙에 없으면 무시)
+  */
+void heap_remove(schedule *sp) {
+	int i = sp->heap_idx;
+
+	if (i < 0)
+		return;
+
+	heap_swap(i, --heap_size);
+	if (i < heap_size) {
+		heap_sift_down(i);
+		heap_sift_up(i);
+	}
+	sp->heap_idx = -1;
+}
+
+/**
+  대기 큐에서 a 가 b 보다 먼저 실행되어야 하는지 비교하는 함수
+  우선순위가 높은 것, 같으면 원래 실행 시각이 이른 것, 같으면 먼저 들어온 것이 먼저
+  */
+static int pending_before(const job_run *a, const job_run *b) {
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+	if (a->sched != b->sched)
+		return a->sched < b->sched;
+	return a->seq < b->seq;
+}
+
+/**
+  지연 큐에서 a 가 b 보다 먼저 풀려나야 하는지 비교하는 함수
+  */
+static int delayed_before(const job_run *a, const job_run *b) {
+	if (a->release != b->release)
+		return a->release < b->release;
+	return a->seq < b->seq;
+}
+
+/**
+  timeout 큐에서 a 가 b 보다 먼저 시그널을 받아야 하는지 비교하는 함수
+  */
+static int expiring_before(const job_run *a, const job_run *b) {
+	if (a->deadline != b->deadline)
+		return a->deadline < b->deadline;
+	return a->seq < b->seq;
+}
+
+/**
+  큐의 두 원소를 바꾸는 함수
+  */
+static void queue_swap(job_queue *q, int i, int j) {
+	job_run *tmp = q->items[i];
+
+	q->items[i] = q->items[j];
+	q->items[j] = tmp;
+	q->items[i]->queue_idx = i;
+	q->items[j]->queue_idx = j;
+}
+
+/**
+  큐의 i 번째 원소를 위로 올리는 함수
+  */
+static void queue_sift_up(job_queue *q, int i) {
+	while (i > 0 && q->before(q->items[i], q->items[(i - 1) / 2])) {
+		queue_swap(q, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+/**
+  큐의 i 번째 원소를 아래로 내리는 함수
+  */
+static void queue_sift_down(job_queue *q, int i) {
+	int child;
+
+	while ((child = 2 * i + 1) < q->count) {
+		if (child + 1 < q->count && q->before(q->items[child + 1], q->items[child]))
+			child++;
+		if (!q->before(q->items[child], q->items[i]))
+			break;
+		queue_swap(q, i, child);
+		i = child;
+	}
+}
+
+/**
+  큐에 명령어를 넣는 함수 (명령어는 한 번에 하나의 큐에만 있을 수 있음)
+  @param q 대기 큐 또는 지연 큐
+  @param run 넣을 명령어
+  */
+void queue_push(job_queue *q, job_run *run) {
+	static unsigned long seq;
+
+	if (q->count == q->cap) {
+		q->cap = q->cap ? q->cap * 2 : 64;
+		q->items = realloc(q->items, q->cap * sizeof(job_run *));
+	}
+
+	run->seq = seq++;
+	q->items[q->count] = run;
+	run->queue_idx = q->count++;
+	queue_sift_up(q, run->queue_idx);
+}
+
+/**
+  큐에서 가장 먼저 꺼내야 할 명령어를 꺼내는 함수
+  @param q 대기 큐 또는 지연 큐
+  @return 꺼낸 명령어, 비어있으면 NULL
+  */
+job_run *queue_pop(job_queue *q) {
+	job_run *run;
+
+	if (q->count == 0)
+		return NULL;
+
+	run = q->items[0];
+	queue_swap(q, 0, --q->count);
+	queue_sift_down(q, 0);
+	run->queue_idx = -1;
+	return run;
+}
+
+/**
+  큐 중간에 있는 명령어를 빼는 함수
+  @param q 명령어가 들어있는 큐
+  @param run 뺄 명령어 (큐에 없으면 무시)
+  */
+void queue_remove(job_queue *q, job_run *run) {
+	int i = run->queue_idx;
+
+	if (i < 0)
+		return;
+
+	queue_swap(q, i, --q->count);
+	if (i < q->count) {
+		queue_sift_down(q, i);
+		queue_sift_up(q, i);
+	}
+	run->queue_idx = -1;
+}
+
+/**
+  명령어마다 고정된 지터 값을 구하는 함수
+  같은 명령어는 daemon 을 다시 시작해도 항상 같은 값을 가지므로 실행 간격이 일정하게 유지됨
+  @param job "주기 명령어" 문자열
+  @param window 지터 범위 (초)
+  @return 0 이상 window 미만의 값 (window 가 1 이하이면 0)
+  */
+int jitter_offset(const char *job, int window) {
+	uint32_t h = 2166136261u;
+
+	if (window <= 1)
+		return 0;
+
+	for (; *job != '\0'; job++) {
+		h ^= (unsigned char) *job;
+		h *= 16777619u;
+	}
+
+	// 비슷한 문자열끼리 하위 비트가 몰리지 않도록 섞음
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h % window;
+}
+
+/**
+  스케줄러가 놓은 테이블을 해제 대기 리스트에 넣는 함수
+  @param snap 예전 테이블
+  */
+static void __retire_table(table_snapshot *snap) {
+	snap->next = atomic_load(&retired);
+	while (!atomic_compare_exchange_weak(&retired, &snap->next, snap))
+		;
+}
 
-void init_daemon();
-void print_log(const char *str);
-void *process_crontab();
-void test(crontab *ct, int min, int hour, int day, int month, int dayofweek);
+/**
+  해제 대기 중인 테이블 중 스케줄러가 놓은 뒤 정지 상태를 한 번 이상 지난 것들을 해제하는 함수 (reload 스레드)
+  스케줄러는 루프 맨 앞에서만 epoch 를 올리므로, 놓을 때의 epoch 보다 커졌다면 더 이상 참조하지 않음
+  */
+static void __reclaim_tables() {
+	table_snapshot *list, *snap;
+	unsigned long epoch = atomic_load(&sched_epoch);
 
-crontab head;
-struct stat cronstat;
-struct tm *tm;
-time_t t;
+	list = atomic_exchange(&retired, NULL);
+	while ((snap = list) != NULL) {
+		list = snap->next;
+		if (snap->epoch < epoch) {
+			free_crontab_table(&snap->table);
+			free(snap);
+		} else
+			__retire_table(snap);
+	}
+}
 
 /**
- daemon 프로세스가 된 이후의 main 역할을 하는 함수
+ daemon 프로세스가 된 이후의 main 역할을 하는 함수 (reload 스레드)
+ 스케줄러 스레드를 한 번 만들어 두고, 이 스레드는 crontab 파일 변경을 inotify 로 기다렸다가
+ 새 테이블을 파싱, 컴파일해서 스케줄러에 넘기고 스케줄러가 놓은 예전 테이블을 해제함
+ 파싱은 스케줄러와 따로 이루어지므로 큰 파일을 다시 읽는 동안에도 실행 시각이 늦어지지 않음
+ 새 테이블은 항상 스케줄러의 현재 테이블과 짝지어 만들어야 하므로 넘긴 테이블을 스케줄러가 가져가기 전에는 다음 테이블을 만들지 않음
+ 제어 소켓으로 바뀐 엔트리는 스케줄러가 이미 반영해 두었으므로 이 스레드는 저널에 쓰기만 하고,
+ 넘긴 테이블이 그 변경 없이 읽혔을 수 있으므로 스케줄러가 가져가기 전에는 저널에 쓰지 않음
+ 저널 끝에만 기록이 붙었으면 파일 전체를 다시 읽지 않고 붙은 기록만 스케줄러에 넘김
  */
 void daemon_main() {
-	pthread_t thread;
-	int thread_id;
+	struct pollfd pfd[3];
+	store_state store;
+	sigset_t mask;
+	pthread_t tid;
+	table_snapshot *snap;
+	uint64_t val = 1;
+	int ifd, wd, lfd = -1, cfd = -1, changed = 1, grew = 0, waiting = 0, unwritten = 0, stale = 0;
+
+	if ((ifd = watch_crontab(&wd)) < 0) {
+		print_log("inotify error\n");
+		exit(1);
+	}
+
+	// 자식 프로세스 종료는 시그널 핸들러 대신 스케줄러 스레드의 signalfd 로 처리
+	// 스레드들이 이 마스크를 물려받도록 스레드를 만들기 전에 막음
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	if ((wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+			|| (adopt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		print_log("eventfd error\n");
+		exit(1);
+	}
+
+	// 상태 파일을 열지 못해도 실행은 계속하고 재시작 때 놓친 실행만 되살리지 못함
+	if (state_file != NULL && state_open(state_file) < 0)
+		print_log(err_str);
 
-	// 파일 생성되기를 대기
-	while (read_crontab_file(&head) < 0 || stat(CRONTAB_FILE, &cronstat) < 0) {
-		print_log("Cannot open crontab file\n");
-		sleep(30);
+	// 제어 소켓을 열지 못해도 실행은 계속하고 ssu_crontab 은 파일을 직접 고침
+	// 소켓 읽기, 쓰기는 제어 스레드가 하고 스케줄러는 요청만 처리함
+	if (control_socket != NULL && ((lfd = ctl_listen(control_socket)) < 0 || (cfd = ctl_start(lfd)) < 0))
+		print_log(err_str);
+
+	if (pthread_create(&tid, NULL, scheduler_main, (void *) (intptr_t) cfd) != 0) {
+		print_log("scheduler thread create error\n");
+		exit(1);
 	}
 
+	pfd[0].fd = ifd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = adopt_fd;
+	pfd[1].events = POLLIN;
+	pfd[2].fd = ctl_fd;
+	pfd[2].events = POLLIN;
+	memset(&store, 0, sizeof(store));
+
 	while (1) {
-		// 스레드 생성
-		thread_id = pthread_create(&thread, NULL, process_crontab, (void *) 0);
-		if (thread_id < 0) {
-			print_log("Creating thread error\n");
-			exit(1);
+		// 저널 끝에 붙은 기록은 스케줄러가 현재 테이블에 바로 적용함
+		if (grew && !waiting && !changed) {
+			int count;
+
+			grew = 0;
+			if ((count = ctl_tail(&store)) < 0)
+				changed = 1;
+			else if (count > 0)
+				write(wake_fd, &val, sizeof(val));
 		}
 
-		// 스레드 종료시 자원을 반환하도록 설정
-		pthread_detach(thread);
-	
-#ifdef DEBUG
-		sleep(5);
-#else
-		sleep(60);
-#endif
+		if (unwritten && !waiting && !changed) {
+			unwritten = 0;
+			if (ctl_persist(&store))
+				changed = 1;
+		}
+
+		if (changed && !waiting) {
+			int lfd;
+
+			changed = grew = 0;
+
+			// 읽는 동안 압축이나 저널 쓰기가 끼어들지 못하도록 잠금
+			if ((lfd = lock_crontab(F_RDLCK)) < 0)
+				print_log(err_str);
+
+			// 읽기 전의 상태를 기록해 두고, 이후의 inotify 이벤트가 이 상태 그대로이면 무시함
+			store_refresh(&store);
+			snap = build_crontab_table(daemon_time());
+			unlock_crontab(lfd);
+
+			// 파일이 아직 없으면 생성될 때 inotify 로 알 수 있음
+			if (snap == NULL) {
+				print_log("Cannot open crontab file\n");
+				store.journal_len = store.journal.st_size;
+			} else {
+				// 스케줄러가 가져간 뒤에는 테이블을 읽을 수 없으므로 넘기기 전에 기록해 둠
+				store.journal_len = snap->table.journal_len;
+				stale = snap->table.journal_stale;
+				snap->ctl_seq = atomic_load(&ctl_persisted);
+				atomic_store(&published, snap);
+				write(wake_fd, &val, sizeof(val));
+				waiting = 1;
+			}
+		}
+
+		// 손으로 고친 파일에 대한 저널은 파일에 합쳐서 새로 시작함
+		if (stale && !waiting) {
+			stale = 0;
+			if (ctl_compact(&store))
+				changed = 1;
+		}
+
+		if (poll(pfd, 3, -1) < 0)
+			continue;
+
+		if (pfd[1].revents & POLLIN) {
+			uint64_t count;
+
+			read(adopt_fd, &count, sizeof(count));
+			waiting = 0;
+			__reclaim_tables();
+		}
+
+		if (pfd[2].revents & POLLIN) {
+			uint64_t count;
+
+			read(ctl_fd, &count, sizeof(count));
+			unwritten = 1;
+		}
+
+		// ctl_persist 와 ctl_compact 가 쓴 파일은 이미 스케줄러의 테이블과 같으므로 다시 읽지 않음
+		if (pfd[0].revents & POLLIN) {
+			int what = crontab_changed(ifd, wd);
+
+			if ((what & CHANGED_FILE) && !file_unchanged(CRONTAB_FILE, &store.file))
+				changed = 1;
+			if ((what & CHANGED_JOURNAL) && !file_unchanged(CRONTAB_JOURNAL, &store.journal))
+				grew = 1;
+		}
+	}
+}
+
+/**
+ 스케줄러 스레드의 main 함수
+ 60초마다 모든 노드를 확인하지 않고, 가장 먼저 실행될 주기의 시각까지 잠들었다가
+ 그 시각이 된 주기들만 꺼내서 그 주기를 쓰는 명령어들을 실행함
+ reload 스레드가 새 테이블을 넘기면 깨어나서 실행 상태만 옮겨받으므로 테이블 접근에 잠금이 필요 없음
+ (제어 요청으로 현재 테이블의 리스트를 바꾸는 동안만 table_lock 을 잡음)
+ @param arg 제어 요청을 알리는 eventfd (ctl_start, intptr_t, 없으면 -1)
+ @return 리턴하지 않음
+ */
+void *scheduler_main(void *arg) {
+	struct pollfd pfd[4];
+	sigset_t mask;
+	table_snapshot *snap;
+	time_t now, last = 0, deadline, export_at = 0;
+	uint64_t val = 1;
+	int tfd, sfd, cfd = (intptr_t) arg, adopted = 0, reconciled = 0;
+
+	if ((tfd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC)) < 0) {
+		print_log("timerfd_create error\n");
+		exit(1);
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	if ((sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+		print_log("signalfd error\n");
+		exit(1);
+	}
+
+	pfd[0].fd = tfd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = wake_fd;
+	pfd[1].events = POLLIN;
+	pfd[2].fd = sfd;
+	pfd[2].events = POLLIN;
+	pfd[3].fd = cfd;
+	pfd[3].events = POLLIN;
+
+	while (1) {
+		// 루프 맨 앞은 어떤 테이블도 참조하지 않는 정지 상태
+		// 지난 바퀴에서 놓은 테이블은 이제 해제해도 되므로 reload 스레드에 알림
+		atomic_fetch_add(&sched_epoch, 1);
+		if (adopted) {
+			write(adopt_fd, &val, sizeof(val));
+			adopted = 0;
+		}
+
+		// 가장 빠른 실행 시각까지 대기, 실행할 노드가 없으면 타이머 해제
+		// 아직 내보내지 않은 메트릭이 있으면 내보낼 시각에도 깨어남
+		deadline = heap_size > 0 ? heap[0]->next_run : 0;
+		if (metrics_file != NULL && metrics.dirty && (deadline == 0 || export_at < deadline))
+			deadline = export_at;
+
+		// 지터만큼 기다리는 명령어가 있으면 가장 먼저 풀려날 시각에도 깨어남
+		if (delayed.count > 0 && (deadline == 0 || delayed.items[0]->release < deadline))
+			deadline = delayed.items[0]->release;
+
+		// 호스트 부하로 미뤄둔 명령어가 있으면 부하를 다시 확인할 시각에도 깨어남
+		if (admit_retry > 0 && (deadline == 0 || admit_retry < deadline))
+			deadline = admit_retry;
+
+		// timeout 이 있는 명령어가 실행 중이면 가장 먼저 시그널을 보낼 시각에도 깨어남
+		if (expiring.count > 0 && (deadline == 0 || expiring.items[0]->deadline < deadline))
+			deadline = expiring.items[0]->deadline;
+		admit_retry = 0;
+		arm_timer(tfd, deadline);
+
+		if (poll(pfd, 4, -1) < 0)
+			continue;
+
+		if (pfd[2].revents & POLLIN)
+			reap_children(sfd);
+
+		now = daemon_time();
+		if (pfd[0].revents & POLLIN) {
+			uint64_t expirations;
+
+			// 시스템 시각이 바뀌면 ECANCELED 로 알려줌
+			// 앞으로 간 경우는 놓친 실행으로 처리되고, 뒤로 간 경우는 다음 실행 시각을 다시 계산
+			if (read(tfd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED && now < last)
+				reschedule_all(now);
+		}
+
+		if (pfd[1].revents & POLLIN) {
+			uint64_t count;
+
+			read(wake_fd, &count, sizeof(count));
+			// 저널 끝에서 읽은 기록은 새 테이블에 이미 들어있으므로 가져오기 전에 적용
+			ctl_apply_incoming(now);
+			if ((snap = atomic_exchange(&published, NULL)) != NULL) {
+				adopt_crontab_table(snap);
+				snap->epoch = atomic_load(&sched_epoch);
+				__retire_table(snap);
+				adopted = 1;
+
+				// 새 테이블을 읽은 뒤에 제어 소켓으로 바뀐 엔트리를 다시 반영
+				ctl_replay(snap->ctl_seq, now);
+
+				// 처음 가져온 테이블로 멈춰있던 동안 놓친 실행을 되살림
+				if (!reconciled) {
+					reconcile_state(now);
+					reconciled = 1;
+				}
+			}
+		}
+
+		if (pfd[3].revents & POLLIN)
+			ctl_serve(now);
+
+		dispatch_due(now);
+		expire_timeouts(now);
+		last = now;
+
+		// 메트릭 파일은 바뀐 값이 있을 때 METRICS_INTERVAL 초에 한 번만 씀
+		if (metrics_file != NULL && metrics.dirty && now >= export_at) {
+			if (metrics_write(metrics_file) < 0)
+				print_log(err_str);
+			export_at = now + METRICS_INTERVAL;
+		}
 	}
+
+	return NULL;
 }
 
+#ifndef BENCH
 int main(int argc, char *argv[]) {
+	int op;
+
+	while ((op = getopt(argc, argv, "j:c:m:l:p:b:J:o:s:C:u:")) != -1) {
+		switch (op) {
+			case 'j':
+				if ((max_jobs = atoi(optarg)) <= 0) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'c':
+				if ((catchup_window = atoi(optarg)) < 0) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'l':
+				if ((max_load = atof(optarg)) < 0) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'p':
+				if ((max_mem_pressure = atof(optarg)) < 0) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'b':
+				if ((defer_budget = atoi(optarg)) < 0) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'J':
+				if ((default_jitter = atoi(optarg)) < 0 || default_jitter > JOB_JITTER_MAX) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'o':
+				if ((default_overlap = parse_name(overlap_names, optarg, strlen(optarg))) < 0) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'C':
+				if ((default_catchup = parse_name(catchup_names, optarg, strlen(optarg))) < 0) {
+					fprintf(stderr, USAGE);
+					exit(1);
+				}
+				break;
+
+			case 'u':
+				// 빈 문자열이면 제어 소켓을 열지 않음
+				control_socket = *optarg != '\0' ? optarg : NULL;
+				break;
+
+			case 's':
+				// 빈 문자열이면 상태를 남기지 않음
+				state_file = *optarg != '\0' ? optarg : NULL;
+				break;
+
+			case 'm':
+				// 빈 문자열이면 메트릭을 내보내지 않음
+				metrics_file = *optarg != '\0' ? optarg : NULL;
+				break;
+
+			default:
+				fprintf(stderr, USAGE);
+				exit(1);
+		}
+	}
+
 	openlog("ssu_crond_log", LOG_CONS | LOG_PID | LOG_NDELAY, 0);
 #ifndef DEBUG
 	init_daemon();
@@ -61,94 +749,1185 @@ int main(int argc, char *argv[]) {
 	daemon_main();
 	exit(0);
 }
+#endif
 
 /**
-  crontab 데이터를 읽고 처리하는 함수 (스레드 실행)
-  파일을 읽고, 모든 명령어를 처리하는 것이 오래걸릴 수 있으므로 스레드로 분리
-  60초 주기로 실행되는 로직 상 이 주기에 대한 오차를 줄일 수 있음
-  예를 들면 파일을 읽고 모든 명령어를 처리하는데 2초가 걸린다면
-  실제로는 62초 주기로 실행되므로 2초가 누적되다보면 문제가 생김
+  timerfd 를 절대 시각 deadline 에 만료되도록 설정하는 함수
+  @param fd timerfd
+  @param deadline 만료 시각, 0 이면 타이머 해제
   */
-void *process_crontab() {
-	struct stat statbuf;
-	crontab *ct;
-	char buf[BUFSIZ];
+void arm_timer(int fd, time_t deadline) {
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline;
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL) < 0)
+		print_log("timerfd_settime error\n");
+}
 
-	if (stat(CRONTAB_FILE, &statbuf) < 0)
-		pthread_exit(NULL);
+/**
+  crontab 파일이 있는 디렉토리를 inotify 로 감시하는 함수
+  파일 자체가 아닌 디렉토리를 감시해야 파일이 새로 생기거나 rename 으로 바뀌는 것도 알 수 있음
+  @param wd 감시 디스크립터를 저장
+  @return 성공 시 inotify fd, 에러 시 -1
+  */
+int watch_crontab(int *wd) {
+	char dir[BUF_SIZE];
+	char *c;
+	int fd;
 
-	// crontab 파일이 변경되었음이 감지된 경우
-	if (statbuf.st_mtime != cronstat.st_mtime) {
-		// crontab 리스트를 비움
-		while (!is_empty_crontab(&head))
-			remove_crontab(head.next);
+	strcpy(dir, CRONTAB_FILE);
+	if ((c = strrchr(dir, '/')) == NULL)
+		strcpy(dir, ".");
+	else
+		*c = '\0';
 
-		// crontab 파일을 다시 읽어서 리스트 재구성
-		if (read_crontab_file(&head)) {
-			print_log("read_crontab_file error\n");
-			pthread_exit(NULL);
-		}
+	if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+		return -1;
 
-		cronstat = statbuf;
+	if ((*wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO)) < 0) {
+		close(fd);
+		return -1;
 	}
 
-	t = time(NULL);
-	tm = localtime(&t);
-	
-	ct = head.next;
-	while (ct != NULL) {
-#ifdef DEBUG
-		printf("%s\n", ct->op);
-#endif
-		if (parse_execute_term(ct->min, tm->tm_min) &&
-			parse_execute_term(ct->hour, tm->tm_hour) &&
-			parse_execute_term(ct->day, tm->tm_mday) &&
-			parse_execute_term(ct->month, tm->tm_mon + 1) &&
-			parse_execute_term(ct->dayofweek, tm->tm_wday)) {
-			
-			// 실행!
-			sprintf(buf, "%s &", ct->op);
+	return fd;
+}
 
-			int sys = system(ct->op);
-			if (sys < 0) {
-				ct = ct->next;
-				continue;
-			}
+/**
+  파일 경로에서 디렉토리를 뺀 이름을 구하는 함수
+  */
+static const char *__base_name(const char *path) {
+	const char *p;
 
-			if (WIFEXITED(sys)) {
-				if ((sys >> 8) == 127) {
-					ct = ct->next;
-					continue;
-				}
-			} else if (WIFSIGNALED(sys)) {
-				ct = ct->next;
-				continue;
-			}
-			else if (WIFSTOPPED(sys)) {
-				ct = ct->next;
-				continue;
-			}
+	return (p = strrchr(path, '/')) == NULL ? path : p + 1;
+}
 
-			sprintf(buf, "run %s %s %s %s %s %s\n", ct->min, ct->hour, ct->day, ct->dayofweek, ct->month, ct->op);
-			log_crontab(buf);
+/**
+  쌓인 inotify 이벤트를 모두 읽고 crontab 파일이나 저널에 대한 이벤트가 있었는지 확인하는 함수
+  @param fd inotify fd
+  @param wd 감시 디스크립터
+  @return 바뀐 파일 (CHANGED_FILE, CHANGED_JOURNAL 의 OR), 없으면 0
+  */
+int crontab_changed(int fd, int wd) {
+	char buf[BUFSIZ] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	const char *fname, *jname;
+	ssize_t len;
+	int changed = 0;
+
+	fname = __base_name(CRONTAB_FILE);
+	jname = __base_name(CRONTAB_JOURNAL);
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *) p;
+			if (ev->wd != wd || ev->len == 0)
+				continue;
+			if (!strcmp(ev->name, fname))
+				changed |= CHANGED_FILE;
+			else if (!strcmp(ev->name, jname))
+				changed |= CHANGED_JOURNAL;
 		}
-		ct = ct->next;
 	}
-	return NULL;
+
+	return changed;
+}
+
+/**
+  crontab 파일을 새 테이블로 읽고 스케줄러의 현재 테이블과 실행 주기 단위로 짝짓는 함수 (reload 스레드)
+  내용이 같은 주기는 예전 주기의 마스크를 쓰고 inherit 에 예전 주기를 기록해두며,
+  새로 생긴 주기만 컴파일하고 다음 실행 시각을 계산함
+  현재 테이블에서는 스케줄러가 바꾸지 않는 문자열과 마스크만 읽으므로 스케줄러와 동시에 실행될 수 있음
+  (제어 요청으로 주기 목록이 바뀌는 동안은 읽지 않도록 짝짓는 동안 table_lock 을 잡음)
+  파일을 읽는 동안 다른 프로세스가 고치지 못하도록 lock_crontab(F_RDLCK) 을 잡은 채로 불러야 함
+  @param now 새로 생긴 주기의 다음 실행 시각 기준
+  @return 새 테이블, 에러 시 NULL
+  */
+table_snapshot *build_crontab_table(time_t now) {
+	static int loaded = 0;
+	struct timespec start;
+	table_snapshot *snap;
+	schedule *sp, *old, **index;
+	size_t size = 1, slot;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// 처음에는 컴파일된 캐시를 쓸 수 있도록 읽고,
+	// 이후에는 파싱만 하고 새로 생긴 주기만 컴파일함
+	snap = calloc(1, sizeof(table_snapshot));
+	init_crontab_table(&snap->table);
+	if ((loaded ? read_crontab_file_raw(&snap->table) : read_crontab_file(&snap->table)) < 0) {
+		free_crontab_table(&snap->table);
+		free(snap);
+		return NULL;
+	}
+
+	// 예전 주기들을 내용 기준 해시 테이블에 넣음 (linear probing)
+	pthread_mutex_lock(&table_lock);
+	while (size < (size_t) table.sched_count * 2 + 1)
+		size <<= 1;
+	index = calloc(size, sizeof(schedule *));
+
+	for (sp = table.scheds; sp != NULL; sp = sp->next) {
+		slot = hash_schedule(sp) & (size - 1);
+		while (index[slot] != NULL)
+			slot = (slot + 1) & (size - 1);
+		index[slot] = sp;
+	}
+
+	// 한 테이블 안의 주기는 모두 다르므로 예전 주기 하나는 많아야 한 번 짝지어짐
+	for (sp = snap->table.scheds; sp != NULL; sp = sp->next) {
+		slot = hash_schedule(sp) & (size - 1);
+		while ((old = index[slot]) != NULL && !equal_schedule(old, sp))
+			slot = (slot + 1) & (size - 1);
+
+		if (old != NULL) {
+			sp->min_mask = old->min_mask;
+			sp->hour_mask = old->hour_mask;
+			sp->day_mask = old->day_mask;
+			sp->month_mask = old->month_mask;
+			sp->dow_mask = old->dow_mask;
+			sp->inherit = old;
+		} else {
+			if (loaded)
+				compile_schedule(sp);
+			sp->next_run = next_fire_time(sp, now);
+		}
+	}
+	pthread_mutex_unlock(&table_lock);
+	free(index);
+
+	loaded = 1;
+	atomic_store(&metrics.parse_ns, (int64_t) (metrics_since(&start) * 1e9));
+	atomic_fetch_add(&metrics.reloads, 1);
+	return snap;
+}
+
+/**
+  build_crontab_table 로 만든 테이블을 현재 테이블로 바꾸는 함수 (스케줄러 스레드)
+  바뀌지 않은 주기는 예전 주기의 다음 실행 시각과 힙 위치를 물려받고,
+  새로 생긴 주기만 힙에 넣고 사라진 주기만 힙에서 뺌
+  파싱과 컴파일은 끝나 있으므로 주기 수에 비례하는 포인터 작업만 함
+  @param snap 새 테이블, 끝나면 예전 테이블을 담고 있음
+  */
+void adopt_crontab_table(table_snapshot *snap) {
+	struct timespec start;
+	crontab_table old_table;
+	schedule *sp, *old;
+	int added = 0, removed;
+#ifdef DEBUG
+	char buf[BUF_SIZE];
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (sp = snap->table.scheds; sp != NULL; sp = sp->next) {
+		if ((old = sp->inherit) != NULL) {
+			sp->next_run = old->next_run;
+			if ((sp->heap_idx = old->heap_idx) >= 0)
+				heap[sp->heap_idx] = sp;
+			old->heap_idx = -1;
+			sp->inherit = NULL;
+		} else {
+			if (sp->next_run >= 0)
+				heap_push(sp);
+			added++;
+		}
+	}
+
+	// 아직 힙에 남아 있는 예전 주기는 파일에서 사라진 주기
+	for (old = table.scheds; old != NULL; old = old->next)
+		heap_remove(old);
+	removed = table.sched_count - (snap->table.sched_count - added);
+
+	old_table = table;
+	table = snap->table;
+	snap->table = old_table;
+	if (table.head.next != NULL)
+		table.head.next->prev = &table.head;
+	if (snap->table.head.next != NULL)
+		snap->table.head.next->prev = &snap->table.head;
+
+	metrics.adopt_ns = metrics_since(&start) * 1e9;
+	metrics.dirty = 1;
+
+#ifdef DEBUG
+	sprintf(buf, "reload crontab: %d entries in %d schedules (%d added, %d removed)\n",
+			table.count, table.sched_count, added, removed);
+	print_log(buf);
+#else
+	(void) removed;
+#endif
+}
+
+/**
+  crontab 파일을 다시 읽어서 바로 현재 테이블로 바꾸는 함수
+  reload 스레드 없이 한 스레드에서 스케줄러를 돌리는 경우 (벤치마크, 부하 테스트) 사용
+  @param now 새로 생긴 주기의 다음 실행 시각 기준
+  @return 성공 시 0, 에러 시 -1
+  */
+int reload_crontab(time_t now) {
+	table_snapshot *snap;
+	int lfd;
+
+	lfd = lock_crontab(F_RDLCK);
+	snap = build_crontab_table(now);
+	unlock_crontab(lfd);
+	if (snap == NULL)
+		return -1;
+
+	adopt_crontab_table(snap);
+	free_crontab_table(&snap->table);
+	free(snap);
+	return 0;
+}
+
+/**
+  로그, 통계, 상태 파일에 쓰는 "주기 명령어" 문자열을 만드는 함수
+  @param ct crontab 노드
+  @param len 주기 부분의 길이 저장 (명령어는 리턴값 + len 부터, NULL 이면 무시)
+  @return 새로 할당한 문자열
+  */
+static char *__format_job(const crontab *ct, int *len) {
+	char buf[BUFSIZ];
+	char *job;
+	int n;
+
+	n = sprintf(buf, "%s %s %s %s %s ", ct->sched->min, ct->sched->hour, ct->sched->day,
+			ct->sched->dayofweek, ct->sched->month);
+	job = malloc(n + strlen(ct->op) + 1);
+	strcpy(job, buf);
+	strcpy(job + n, ct->op);
+	if (len != NULL)
+		*len = n;
+	return job;
+}
+
+/**
+  명령어의 catch-up 정책을 구하는 함수 (실행 옵션에 없으면 ssu_crond 기본값)
+  @param ct crontab 노드
+  @return CATCHUP_*
+  */
+static int __catchup_policy(const crontab *ct) {
+	return ct->opts != NULL && ct->opts->catchup >= 0 ? ct->opts->catchup : default_catchup;
+}
+
+/**
+  실행 시각이 된 주기들을 힙에서 꺼내 그 주기의 명령어들을 실행하고 다음 실행 시각으로 다시 넣는 함수
+  힙의 맨 앞만 확인하므로 전체 노드 수가 아닌 실행할 주기 수에 비례하는 비용이 들고,
+  같은 주기를 쓰는 명령어가 많아도 다음 실행 시각은 주기마다 한 번만 계산함
+  절전이나 부하로 daemon 이 멈춰있었다면 놓친 분들을 하나씩 찾아서
+  catchup_window 분 이내의 것은 명령어의 catch-up 정책대로 다시 실행하고 그 이전 것은 버림
+  @param now 현재 시각
+  */
+void dispatch_due(time_t now) {
+	struct timespec start;
+	schedule *sp;
+	crontab *ct;
+	time_t t, oldest, minute, last = -1;
+	char buf[BUFSIZ];
+	char *job;
+	int due = 0, missed, skipped, policy;
+
+	if (heap_size == 0 || heap[0]->next_run > now) {
+		launch_pending();
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// 현재 분은 catchup_window 와 catch-up 정책에 상관없이 항상 실행
+	minute = now - now % 60;
+	oldest = now - catchup_window * 60 - 60;
+
+	while (heap_size > 0 && heap[0]->next_run <= now) {
+		sp = heap_pop();
+		t = sp->next_run;
+
+		// 되살릴 수 있는 범위 이전에 놓친 실행은 한 번에 건너뜀
+		if (t <= oldest) {
+			for (ct = sp->jobs; ct != NULL; ct = ct->group_next) {
+				job = __format_job(ct, NULL);
+				snprintf(buf, sizeof(buf), "skip %s (missed runs before the catch-up window)\n", job);
+				log_crontab(buf);
+				job_stats_get(job)->skips++;
+				free(job);
+			}
+			t = next_fire_time(sp, oldest);
+		}
+
+		// 이번 분 전에 놓친 실행은 명령어마다 catch-up 정책대로 되살림
+		missed = 0;
+		for (; t >= 0 && t < minute; t = next_fire_time(sp, t)) {
+			for (ct = sp->jobs; ct != NULL; ct = ct->group_next) {
+				if (__catchup_policy(ct) == CATCHUP_ALL) {
+					process_crontab(ct, t);
+					due++;
+				}
+			}
+			last = t;
+			missed++;
+		}
+		for (ct = sp->jobs; missed > 0 && ct != NULL; ct = ct->group_next) {
+			if ((policy = __catchup_policy(ct)) == CATCHUP_ALL)
+				continue;
+			if (policy == CATCHUP_ONCE) {
+				process_crontab(ct, last);
+				due++;
+			}
+			if ((skipped = missed - (policy == CATCHUP_ONCE)) > 0) {
+				job = __format_job(ct, NULL);
+				snprintf(buf, sizeof(buf), "skip %s (%d missed runs by the catch-up policy)\n", job, skipped);
+				log_crontab(buf);
+				job_stats_get(job)->skips += skipped;
+				free(job);
+			}
+		}
+
+		for (; t >= 0 && t <= now; t = next_fire_time(sp, t)) {
+			for (ct = sp->jobs; ct != NULL; ct = ct->group_next)
+				process_crontab(ct, t);
+			due += sp->job_count;
+		}
+
+		if ((sp->next_run = t) >= 0)
+			heap_push(sp);
+	}
+
+	metrics_tick(&start, due);
+	launch_pending();
+}
+
+/**
+  모든 주기의 다음 실행 시각을 다시 계산해서 힙을 재구성하는 함수
+  시스템 시각이 뒤로 바뀐 경우 사용
+  @param now 기준 시각
+  */
+void reschedule_all(time_t now) {
+	schedule *sp;
+
+	heap_size = 0;
+	for (sp = table.scheds; sp != NULL; sp = sp->next) {
+		sp->heap_idx = -1;
+		if ((sp->next_run = next_fire_time(sp, now - 1)) >= 0)
+			heap_push(sp);
+	}
+}
+
+/**
+  after 이후 now 까지 중 실행 주기가 맞는 가장 늦은 시각을 구하는 함수
+  놓친 실행 시각을 처음부터 하나씩 세지 않도록 최근 1분, 1시간, 1일, 1달, 1년 범위부터 찾음
+  @param sp 실행 주기
+  @param after 이 시각 이후만 봄
+  @param now 이 시각까지 봄
+  @return 가장 늦은 실행 시각, 없으면 -1
+  */
+static time_t __last_fire(const schedule *sp, time_t after, time_t now) {
+	static const time_t windows[] = { 60, 3600, 86400, 31 * 86400, 366 * 86400, 0 };
+	time_t from, t, last = -1;
+
+	for (int i = 0; ; i++) {
+		from = windows[i] > 0 && now - windows[i] > after ? now - windows[i] : after;
+		if ((t = next_fire_time(sp, from)) >= 0 && t <= now)
+			break;
+		if (from == after)
+			return -1;
+	}
+
+	for (; t >= 0 && t <= now; t = next_fire_time(sp, t))
+		last = t;
+	return last;
+}
+
+/**
+  상태 파일과 맞춰서 daemon 이 멈춰있던 동안 놓친 실행을 되살리는 함수 (스케줄러 스레드)
+  처음 테이블을 가져온 직후 한 번만 부르며, 이때 힙의 다음 실행 시각은 모두 now 이후이므로
+  명령어마다 마지막으로 실행을 시작한 시각부터 now 까지만 보면 같은 분이 두 번 실행되지 않음
+  상태 파일에 없는 명령어(상태 파일이 없거나 비어 있을 때 포함)는 이번 분 직전까지 실행한 것으로 보므로
+  놓친 실행 없이 이번 분만 실행됨
+  @param now 현재 시각
+  */
+void reconcile_state(time_t now) {
+	crontab *ct;
+	char *job;
+	time_t t, oldest, minute, last;
+	int idx, policy;
+
+	minute = now - now % 60;
+	oldest = now - catchup_window * 60 - 60;
+	for (ct = table.head.next; ct != NULL; ct = ct->next) {
+		last = minute - 1;
+		if (state_file != NULL) {
+			job = __format_job(ct, NULL);
+			idx = state_find(job, 0);
+			if (idx < 0 && (idx = state_find(job, 1)) >= 0)
+				state_at(idx)->last_sched = last;
+			free(job);
+			// 기록할 자리가 없으면 상태 파일에 없는 명령어처럼 이번 분만 봄
+			if (idx >= 0)
+				last = state_at(idx)->last_sched;
+		}
+
+		// 이번 분 전까지 놓친 실행
+		policy = __catchup_policy(ct);
+		if (policy == CATCHUP_ONCE) {
+			if ((t = __last_fire(ct->sched, last, minute - 1)) >= 0)
+				process_crontab(ct, t);
+		} else if (policy == CATCHUP_ALL) {
+			// 너무 오래 멈춰있었으면 catch-up 범위 안의 것만 실행
+			t = next_fire_time(ct->sched, last > oldest ? last : oldest);
+			for (; t >= 0 && t < minute; t = next_fire_time(ct->sched, t))
+				process_crontab(ct, t);
+		}
+
+		// 이번 분은 catch-up 정책과 상관없이 아직 실행하지 않았으면 실행
+		if (last < minute && next_fire_time(ct->sched, minute - 1) == minute)
+			process_crontab(ct, minute);
+	}
+}
+
+/**
+  실행할 수 있게 된 명령어를 대기 큐에 넣고 실행 지연을 기록하는 함수
+  실행 지연은 지터를 더한 목표 시각부터 잼
+  @param run 넣을 명령어
+  */
+static void __enqueue_run(job_run *run) {
+	daemon_clock(&run->queued);
+	histogram_observe(&run->stats->lateness, time_bounds,
+			(run->queued.tv_sec - run->release) + run->queued.tv_nsec / 1e9);
+	queue_push(&pending, run);
+}
+
+/**
+  실행 시각이 된 crontab 명령어를 실행 대기 큐에 넣는 함수
+  지터가 있으면 지연 큐에서 기다렸다가 대기 큐로 옮겨지고,
+  실제 실행은 launch_pending 에서 동시 실행 수 제한 안에서 이루어짐
+  @param ct 실행할 노드
+  @param sched 원래 실행되어야 했던 시각
+  */
+void process_crontab(const crontab *ct, time_t sched) {
+	job_run *run;
+	char buf[BUFSIZ];
+	char when[SM_BUF_SIZE];
+	char *job;
+	struct tm tm;
+	const char *cmd = ct->opts != NULL ? ct->opts->cmd : ct->op;
+	time_t now;
+	int len, window;
+
+	// 옵션이 잘못된 명령어는 실행하지 않음
+	if (cmd == NULL) {
+		job = __format_job(ct, NULL);
+		log_printf(CRONTAB_LOG, "fail %s (invalid options)\n", job);
+		free(job);
+		return;
+	}
+
+	run = calloc(1, sizeof(job_run));
+	run->desc = __format_job(ct, &len);
+	run->op = run->desc + len + (cmd - ct->op);
+	run->sched = sched;
+	run->priority = ct->opts != NULL ? ct->opts->priority : 0;
+	run->overlap = ct->opts != NULL && ct->opts->overlap >= 0 ? ct->opts->overlap : default_overlap;
+	if (ct->opts != NULL)
+		run->limits = ct->opts->limits;
+	else
+		run->limits.nice = JOB_NICE_KEEP;
+	run->stats = job_stats_get(run->desc);
+	run->queue_idx = -1;
+	run->report = -1;
+
+	// 실행 시각과 같은 분 안에서 명령어마다 고정된 만큼 늦춰서 한꺼번에 실행되지 않게 함
+	window = ct->opts != NULL && ct->opts->jitter >= 0 ? ct->opts->jitter : default_jitter;
+	run->release = sched + jitter_offset(run->desc, window);
+
+	// 놓쳤던 분을 되살려 실행하는 경우
+	now = daemon_time();
+	if (now - sched >= 60) {
+		localtime_r(&sched, &tm);
+		strftime(when, sizeof(when), "%H:%M", &tm);
+		sprintf(buf, "catchup %s (scheduled %s)\n", run->desc, when);
+		log_crontab(buf);
+	}
+
+	if (run->release > now)
+		queue_push(&delayed, run);
+	else
+		__enqueue_run(run);
+}
+
+/**
+  지터만큼 기다린 명령어들을 지연 큐에서 대기 큐로 옮기는 함수
+  @param now 현재 시각
+  */
+static void __release_delayed(time_t now) {
+	while (delayed.count > 0 && delayed.items[0]->release <= now)
+		__enqueue_run(queue_pop(&delayed));
+}
+
+/**
+  /proc 파일 하나를 읽는 함수
+  @param path 파일 경로
+  @param buf 내용을 저장할 버퍼 (BUF_SIZE), NULL 로 끝남
+  @return 읽은 바이트 수, 에러 시 -1
+  */
+static ssize_t __read_proc(const char *path, char *buf) {
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+	len = read(fd, buf, BUF_SIZE - 1);
+	close(fd);
+	if (len >= 0)
+		buf[len] = '\0';
+	return len;
+}
+
+/**
+  호스트 부하가 설정한 한도를 넘었는지 확인하는 함수
+  /proc/loadavg 의 1분 평균을 CPU 수로 나눈 값과 /proc/pressure/memory 의 some avg10 을 보며,
+  같은 초 안에서는 파일을 다시 읽지 않고 이전 결과를 씀
+  @param now 현재 시각
+  @return 한도를 넘었으면 1 아니면 0
+  */
+int host_pressured(time_t now) {
+	static time_t checked = -1;
+	static int pressured;
+	static long ncpu;
+	char buf[BUF_SIZE];
+	char *p;
+
+	if (max_load <= 0 && max_mem_pressure <= 0)
+		return 0;
+	if (now == checked)
+		return pressured;
+	checked = now;
+	pressured = 0;
+
+	if (ncpu <= 0 && (ncpu = sysconf(_SC_NPROCESSORS_ONLN)) <= 0)
+		ncpu = 1;
+
+	if (max_load > 0 && __read_proc("/proc/loadavg", buf) > 0) {
+		host_load = strtod(buf, NULL) / ncpu;
+		pressured |= host_load > max_load;
+	}
+
+	// PSI 가 없는 커널에서는 메모리 압박을 보지 않음
+	if (max_mem_pressure > 0 && __read_proc("/proc/pressure/memory", buf) > 0
+			&& (p = strstr(buf, "avg10=")) != NULL) {
+		host_mem_pressure = strtod(p + 6, NULL);
+		pressured |= host_mem_pressure > max_mem_pressure;
+	}
+
+	metrics.dirty = 1;
+	return pressured;
+}
+
+/**
+  이전 실행이 아직 안 끝난 명령어를 겹침 정책대로 처리하는 함수
+  queue 는 명령어별로 OVERLAP_QUEUE_MAX 개까지만 기다리게 하고 넘치면 버림
+  @param run 실행하려는 명령어
+  @return 지금 실행하면 1, 버렸거나 기다리게 했으면 0
+  */
+static int __resolve_overlap(job_run *run) {
+	job_stats *stats = run->stats;
+	job_run *rp;
+	char buf[BUFSIZ];
+
+	switch (run->overlap) {
+		case OVERLAP_QUEUE:
+			if (stats->held < OVERLAP_QUEUE_MAX) {
+				run->next = NULL;
+				if (stats->held_tail != NULL)
+					stats->held_tail->next = run;
+				else
+					stats->held_head = run;
+				stats->held_tail = run;
+				stats->held++;
+				held_count++;
+				metrics.dirty = 1;
+				return 0;
+			}
+			sprintf(buf, "skip %s (%d runs already waiting)\n", run->desc, stats->held);
+			break;
+
+		case OVERLAP_SKIP:
+			sprintf(buf, "skip %s (previous run still running)\n", run->desc);
+			break;
+
+		case OVERLAP_KILL:
+			// 셸이 띄운 자식까지 정리되도록 프로세스 그룹 전체에 보냄
+			for (rp = running.next; rp != NULL; rp = rp->next) {
+				if (rp->stats != stats || rp->replaced)
+					continue;
+				kill(-rp->pid, SIGTERM);
+				rp->replaced = 1;
+				stats->replaced++;
+			}
+			metrics.dirty = 1;
+			return 1;
+
+		default:
+			return 1;
+	}
+
+	log_crontab(buf);
+	stats->overlap_skips++;
+	metrics.dirty = 1;
+	free(run->desc);
+	free(run);
+	return 0;
+}
+
+/**
+  명령어를 실행하고 실행 중 리스트에 넣는 함수
+  이전 실행이 아직 안 끝났으면 겹침 정책을 먼저 따름
+  @param run 대기 큐에서 꺼낸 명령어, 실행하지 못하거나 버려지면 해제됨
+  */
+static void __start_job(job_run *run) {
+	if (run->stats->live > 0 && !__resolve_overlap(run))
+		return;
+
+	if (launch_job(run) < 0) {
+		free(run->desc);
+		free(run);
+		return;
+	}
+
+	// 실행 중 리스트에 추가
+	run->prev = &running;
+	run->next = running.next;
+	if (running.next != NULL)
+		running.next->prev = run;
+	running.next = run;
+	running_count++;
+
+	if (launch_hook != NULL)
+		launch_hook(run);
+}
+
+/**
+  호스트 부하로 미뤄진 명령어들을 훑어서 미룰 수 있는 시간을 넘긴 것은 실행하는 함수
+  대기 큐 전체를 훑으므로 1초에 한 번만 함
+  처음 훑을 때 미뤄진 명령어로 표시하고 통계에 남김
+  @param now 현재 시각
+  */
+static void __admit_expired(time_t now) {
+	static time_t scanned = -1;
+	job_run **expired;
+	job_run *run;
+	int n = 0;
+
+	if (now == scanned || pending.count == 0)
+		return;
+	// 메모리가 모자라면 다음 틱에 다시 훑음
+	if ((expired = malloc(pending.count * sizeof *expired)) == NULL)
+		return;
+	scanned = now;
+
+	for (int i = 0; i < pending.count; i++) {
+		run = pending.items[i];
+		if (run->priority >= 0)
+			continue;
+		if (now - run->sched >= defer_budget)
+			expired[n++] = run;
+		else if (!run->deferred) {
+			run->deferred = 1;
+			run->stats->deferrals++;
+		}
+	}
+
+	for (int i = 0; i < n && running_count < max_jobs; i++) {
+		queue_remove(&pending, expired[i]);
+		__start_job(expired[i]);
+	}
+	free(expired);
+}
+
+/**
+  동시 실행 수 제한 안에서 대기 큐의 명령어들을 우선순위 순서로 실행하는 함수
+  fork 후 기다리지 않고 바로 돌아오므로 느린 명령어가 다른 명령어를 막지 않음
+  우선순위가 0 미만인 명령어는 호스트 부하가 한도를 넘으면 defer_budget 초까지 미뤄서
+  우선순위가 높은 명령어가 부하가 몰릴 때도 바로 실행될 수 있게 함
+  */
+void launch_pending() {
+	job_run *run;
+	time_t now = daemon_time();
+
+	__release_delayed(now);
+
+	while (running_count < max_jobs && pending.count > 0) {
+		run = pending.items[0];
+
+		// 힙 순서상 맨 앞이 미룰 수 있는 명령어면 남은 명령어도 모두 미룰 수 있는 명령어
+		if (run->priority < 0 && now - run->sched < defer_budget && host_pressured(now)) {
+			__admit_expired(now);
+			admit_retry = now + 1;
+			break;
+		}
+
+		__start_job(queue_pop(&pending));
+	}
+}
+
+/**
+  timeout 이 지난 명령어의 프로세스 그룹에 SIGTERM 을 보내는 함수
+  TIMEOUT_GRACE 초 안에 끝나지 않으면 SIGKILL 을 보냄
+  @param now 현재 시각
+  */
+void expire_timeouts(time_t now) {
+	job_run *run;
+
+	while (expiring.count > 0 && expiring.items[0]->deadline <= now) {
+		run = queue_pop(&expiring);
+		if (run->timed_out) {
+			kill(-run->pid, SIGKILL);
+			continue;
+		}
+
+		kill(-run->pid, SIGTERM);
+		run->timed_out = 1;
+		run->stats->timeouts++;
+		metrics.dirty = 1;
+		run->deadline = now + TIMEOUT_GRACE;
+		queue_push(&expiring, run);
+	}
+}
+
+/**
+  셸 기능이 필요 없는 명령어를 인자 벡터로 나누는 함수
+  @param op 명령어 문자열
+  @param buf 인자들이 저장될 버퍼 (BUF_SIZE 이상)
+  @param argv 인자 벡터를 저장 (BUF_SIZE / 2 + 1 개 이상), NULL 로 끝남
+  @return 인자 갯수, 셸을 거쳐야 하는 명령어면 -1
+  */
+int split_command(const char *op, char *buf, char **argv) {
+	// 셸에서만 의미가 있는 내장 명령어
+	static const char *builtins[] = {
+		".", ":", "alias", "break", "cd", "command", "continue", "eval", "exec", "exit",
+		"export", "readonly", "return", "set", "shift", "times", "trap", "ulimit",
+		"umask", "unset", "wait", NULL
+	};
+	int argc = 0;
+	char *p;
+
+	if (strpbrk(op, SHELL_META) != NULL || strlen(op) >= BUF_SIZE)
+		return -1;
+
+	strcpy(buf, op);
+	for (p = strtok(buf, " \t"); p != NULL; p = strtok(NULL, " \t"))
+		argv[argc++] = p;
+	argv[argc] = NULL;
+
+	// 빈 명령어, 환경 변수 대입 (A=1 cmd), 내장 명령어는 셸에 맡김
+	if (argc == 0 || strchr(argv[0], '=') != NULL)
+		return -1;
+	for (int i = 0; builtins[i] != NULL; i++) {
+		if (!strcmp(argv[0], builtins[i]))
+			return -1;
+	}
+
+	return argc;
+}
+
+/**
+  명령어의 상태 파일 레코드를 구하는 함수
+  레코드 번호는 명령어 통계에 기억해두므로 문자열 해시는 명령어마다 한 번만 구함
+  @param stats 명령어 통계
+  @return 상태 레코드, 상태 파일을 열지 않았으면 NULL
+  */
+static state_record *__job_state(job_stats *stats) {
+	if (stats->state_idx < 0 && (stats->state_idx = state_find(stats->job, 1)) < 0)
+		return NULL;
+	return state_at(stats->state_idx);
+}
+
+// __apply_limits 가 실패한 단계 이름
+static const char *limit_steps[] = {
+	NULL, "setpgid", "sched_setaffinity", "ioprio_set", "setpriority",
+	"setrlimit(RLIMIT_AS)", "setrlimit(RLIMIT_CPU)", "exec"
+};
+
+// fork 된 자식이 exec 전에 걸 제한 (자식에서는 시스템 콜만 부르도록 부모가 미리 계산함)
+typedef struct limit_plan {
+	const job_limits *lp;
+	cpu_set_t set;			// lp->affinity 를 바꾼 CPU 집합
+	struct rlimit mem;		// RLIMIT_AS
+	struct rlimit cpu;		// RLIMIT_CPU
+} limit_plan;
+
+/**
+  걸 rlimit 을 계산하는 함수
+  비특권 프로세스는 hard limit 을 올릴 수 없으므로 지금 hard limit 보다 크게 걸지 않음
+  @return 성공 시 0, 에러 시 -1
+  */
+static int __plan_rlimit(int resource, rlim_t soft, rlim_t hard, struct rlimit *rl) {
+	if (getrlimit(resource, rl) < 0)
+		return -1;
+	rl->rlim_max = hard < rl->rlim_max ? hard : rl->rlim_max;
+	rl->rlim_cur = soft < rl->rlim_max ? soft : rl->rlim_max;
+	return 0;
+}
+
+/**
+  fork 된 자식에서 exec 전에 프로세스 제한을 거는 함수
+  멀티 스레드 프로세스를 fork 한 자식이므로 async-signal-safe 한 시스템 콜만 부름
+  @param plan 부모가 계산해둔 제한
+  @return 성공 시 0, 실패하면 limit_steps 의 실패한 단계 번호 (errno 설정)
+  */
+static int __apply_limits(const limit_plan *plan) {
+	const job_limits *lp = plan->lp;
+	sigset_t mask;
+
+	// daemon 이 막아둔 SIGCHLD 를 명령어에는 물려주지 않음
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+
+	if (setpgid(0, 0) < 0)
+		return 1;
+
+	if (lp->affinity != 0 && sched_setaffinity(0, sizeof(plan->set), &plan->set) < 0)
+		return 2;
+
+	// glibc 에 래퍼가 없으므로 직접 부름 (IOPRIO_WHO_PROCESS, 클래스는 상위 3비트)
+	if (lp->ioclass != JOB_IOCLASS_NONE && syscall(SYS_ioprio_set, 1, 0, lp->ioclass << 13 | lp->iolevel) < 0)
+		return 3;
+
+	if (lp->nice != JOB_NICE_KEEP && setpriority(PRIO_PROCESS, 0, lp->nice) < 0)
+		return 4;
+
+	if (lp->mem != 0 && setrlimit(RLIMIT_AS, &plan->mem) < 0)
+		return 5;
+
+	if (lp->cpu != 0 && setrlimit(RLIMIT_CPU, &plan->cpu) < 0)
+		return 6;
+
+	return 0;
+}
+
+/**
+  명령어 이름을 PATH 에서 찾는 함수 (fork 된 자식에서 execvp 를 쓰지 않도록 부모에서 찾음)
+  @param file 명령어 이름 ('/' 가 있으면 그대로 씀)
+  @param path 찾은 경로 저장 (PATH_MAX 크기)
+  @return 성공 시 0, 에러 시 errno 값
+  */
+static int __resolve_path(const char *file, char *path) {
+	const char *dirs, *end;
+	int err = ENOENT;
+	size_t len;
+
+	if (strchr(file, '/') != NULL) {
+		if (strlen(file) >= PATH_MAX)
+			return ENAMETOOLONG;
+		strcpy(path, file);
+		return 0;
+	}
+
+	if ((dirs = getenv("PATH")) == NULL)
+		dirs = "/bin:/usr/bin";
+	for (; ; dirs = end + 1) {
+		if ((end = strchr(dirs, ':')) == NULL)
+			end = dirs + strlen(dirs);
+
+		// 빈 항목은 현재 디렉토리
+		len = end - dirs;
+		if (len + strlen(file) + 2 <= PATH_MAX) {
+			sprintf(path, "%.*s%s%s", (int) len, dirs, len > 0 ? "/" : "", file);
+			if (access(path, X_OK) == 0)
+				return 0;
+			if (errno != ENOENT && errno != ENOTDIR)
+				err = errno;
+		}
+		if (*end == '\0')
+			return err;
+	}
+}
+
+/**
+  제한을 걸어야 하는 명령어를 fork 해서 실행하는 함수
+  posix_spawn 으로는 nice, ionice, CPU affinity, rlimit 을 걸 수 없으므로 이런 명령어만
+  페이지 테이블을 복사하는 비용을 감수하고 fork 를 씀
+  자식이 exec 전에 실패하면 CLOEXEC 파이프로 실패한 단계와 errno 를 알려주고,
+  스케줄러가 exec 까지 기다리지 않도록 파이프는 자식을 거둘 때 읽음 (__read_report)
+  @param pid 자식 pid 저장
+  @param report 실패를 읽을 파이프 저장
+  @param path exec 할 파일 (NULL 이면 argv[0] 을 PATH 에서 찾음)
+  @param argv 인자 벡터
+  @param lp 걸 제한
+  @param step 실패한 단계 이름 저장
+  @return 성공 시 0, 에러 시 errno 값
+  */
+static int __spawn_limited(pid_t *pid, int *report, const char *path, char **argv, const job_limits *lp, const char **step) {
+	char file[PATH_MAX];
+	limit_plan plan = { .lp = lp };
+	int fail[2];		// 실패한 단계, errno
+	int fds[2];
+
+	if (path == NULL && (fail[1] = __resolve_path(argv[0], file)) != 0) {
+		*step = limit_steps[7];
+		return fail[1];
+	}
+	if (path == NULL)
+		path = file;
+
+	CPU_ZERO(&plan.set);
+	for (int i = 0; i < 64; i++) {
+		if (lp->affinity >> i & 1)
+			CPU_SET(i, &plan.set);
+	}
+	if ((lp->mem != 0 && __plan_rlimit(RLIMIT_AS, lp->mem, lp->mem, &plan.mem) < 0)
+			|| (lp->cpu != 0 && __plan_rlimit(RLIMIT_CPU, lp->cpu, lp->cpu + CPU_LIMIT_GRACE, &plan.cpu) < 0)) {
+		*step = "getrlimit";
+		return errno;
+	}
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		*step = "pipe";
+		return errno;
+	}
+
+	if ((*pid = fork()) < 0) {
+		fail[1] = errno;
+		close(fds[0]);
+		close(fds[1]);
+		*step = "fork";
+		return fail[1];
+	}
+
+	if (*pid == 0) {
+		close(fds[0]);
+		if ((fail[0] = __apply_limits(&plan)) == 0) {
+			execve(path, argv, environ);
+			fail[0] = 7;
+		}
+		fail[1] = errno;
+		write(fds[1], fail, sizeof(fail));
+		_exit(127);
+	}
+
+	close(fds[1]);
+	*report = fds[0];
+	return 0;
+}
+
+/**
+  __spawn_limited 로 실행한 자식이 exec 전에 실패했는지 확인하는 함수 (자식을 거둔 뒤 부름)
+  @param run 거둔 명령어
+  @param fail 실패했으면 실패한 단계 번호와 errno 저장
+  @return 실패했으면 1 아니면 0
+  */
+static int __read_report(job_run *run, int fail[2]) {
+	ssize_t n;
+
+	if (run->report < 0)
+		return 0;
+	while ((n = read(run->report, fail, 2 * sizeof(int))) < 0 && errno == EINTR)
+		;
+	close(run->report);
+	run->report = -1;
+	return n == 2 * sizeof(int);
+}
+
+/**
+  명령어 하나를 자식 프로세스로 실행하는 함수
+  posix_spawn 은 vfork 방식으로 동작하므로 daemon 의 페이지 테이블을 복사하지 않고,
+  셸 기능이 필요 없는 명령어는 /bin/sh 를 거치지 않고 바로 실행함
+  프로세스 제한이 있는 명령어는 __spawn_limited 로 실행하고, timeout 이 있으면 timeout 큐에 넣음
+  @param run 실행할 명령어, pid 와 시작 시각이 설정됨
+  @return 성공 시 0, 에러 시 -1
+  */
+int launch_job(job_run *run) {
+	posix_spawnattr_t attr;
+	sigset_t mask;
+	pid_t pid;
+	char buf[BUF_SIZE];
+	char msg[BUFSIZ];
+	char *argv[BUF_SIZE / 2 + 1];
+	const char *step = NULL;
+	state_record *rec;
+	int err, shell = 0;
+
+	if (split_command(run->op, buf, argv) <= 0) {
+		argv[0] = "sh";
+		argv[1] = "-c";
+		argv[2] = (char *) run->op;
+		argv[3] = NULL;
+		shell = 1;
+	}
+
+	if (job_limited(&run->limits)) {
+		err = __spawn_limited(&pid, &run->report, shell ? "/bin/sh" : NULL, argv, &run->limits, &step);
+		goto spawned;
+	}
+
+	// daemon 이 막아둔 SIGCHLD 를 명령어에는 물려주지 않음
+	posix_spawnattr_init(&attr);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+
+	// overlap=kill 이 셸이 띄운 자식까지 종료시킬 수 있도록 명령어마다 프로세스 그룹을 따로 만듦
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+	if (!shell)
+		err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+	else
+		err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+
+spawned:
+	if (err != 0) {
+		if (step != NULL)
+			sprintf(msg, "fail %s (%s: %s)\n", run->desc, step, strerror(err));
+		else
+			sprintf(msg, "fail %s (%s)\n", run->desc, strerror(err));
+		log_crontab(msg);
+		run->stats->spawn_error++;
+		metrics.dirty = 1;
+		return -1;
+	}
+
+#ifdef DEBUG
+	printf("%s\n", run->op);
+#endif
+	run->pid = pid;
+	clock_gettime(CLOCK_MONOTONIC, &run->start);
+	daemon_clock(&run->launched);
+
+	// 이전 실행이 아직 안 끝났으면 겹친 실행
+	if (run->stats->live++ > 0)
+		run->stats->overlaps++;
+	run->stats->runs++;
+
+	// 재시작해도 같은 분을 다시 실행하지 않도록 실행을 시작한 실행 시각을 바로 남김
+	if ((rec = __job_state(run->stats)) != NULL && run->sched > rec->last_sched)
+		rec->last_sched = run->sched;
+	histogram_observe(&run->stats->launch_latency, time_bounds,
+			(run->launched.tv_sec - run->queued.tv_sec) + (run->launched.tv_nsec - run->queued.tv_nsec) / 1e9);
+
+	// 초 단위 타이머이므로 올림해서 timeout 보다 일찍 종료시키지 않음
+	if (run->limits.timeout > 0) {
+		run->deadline = run->launched.tv_sec + (run->launched.tv_nsec > 0) + run->limits.timeout;
+		queue_push(&expiring, run);
+	}
+	return 0;
+}
+
+/**
+  종료된 자식 프로세스들을 거두고 종료 상태와 실행 시간을 로그로 남기는 함수
+  @param fd SIGCHLD 를 받는 signalfd
+  */
+void reap_children(int fd) {
+	struct signalfd_siginfo si;
+	struct timespec end;
+	job_run *run;
+	job_stats *stats;
+	state_record *rec;
+	char buf[BUFSIZ];
+	long elapsed;
+	pid_t pid;
+	int status, failed;
+	int fail[2];		// exec 전에 실패한 단계, errno
+
+	// 여러 SIGCHLD 가 하나로 합쳐질 수 있으므로 읽기만 하고 waitpid 로 모두 거둠
+	while (read(fd, &si, sizeof(si)) == sizeof(si))
+		;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		for (run = running.next; run != NULL; run = run->next) {
+			if (run->pid == pid)
+				break;
+		}
+		if (run == NULL)
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = (end.tv_sec - run->start.tv_sec) * 1000 + (end.tv_nsec - run->start.tv_nsec) / 1000000;
+
+		if ((failed = __read_report(run, fail))) {
+			sprintf(buf, "fail %s (%s: %s)\n", run->desc, limit_steps[fail[0]], strerror(fail[1]));
+		} else if (WIFEXITED(status) && WEXITSTATUS(status) != 127) {
+			sprintf(buf, "run %s (exit %d, %ld.%03ld sec)\n",
+					run->desc, WEXITSTATUS(status), elapsed / 1000, elapsed % 1000);
+		} else if (WIFEXITED(status)) {
+			sprintf(buf, "fail %s (command not found, %ld.%03ld sec)\n",
+					run->desc, elapsed / 1000, elapsed % 1000);
+		} else if (run->timed_out) {
+			sprintf(buf, "timeout %s (signal %d, %ld.%03ld sec)\n",
+					run->desc, WTERMSIG(status), elapsed / 1000, elapsed % 1000);
+		} else if (run->replaced) {
+			sprintf(buf, "replaced %s (signal %d, %ld.%03ld sec)\n",
+					run->desc, WTERMSIG(status), elapsed / 1000, elapsed % 1000);
+		} else {
+			sprintf(buf, "fail %s (signal %d, %ld.%03ld sec)\n",
+					run->desc, WTERMSIG(status), elapsed / 1000, elapsed % 1000);
+		}
+		log_crontab(buf);
+
+		stats = run->stats;
+		stats->live--;
+		if ((rec = __job_state(stats)) != NULL)
+			rec->last_done = daemon_time();
+		histogram_observe(&stats->duration, time_bounds, metrics_since(&run->start));
+		if (failed) {
+			// 제한을 걸지 못해서 명령어는 실행되지 않음
+			stats->runs--;
+			stats->spawn_error++;
+		} else if (WIFEXITED(status)) {
+			stats->last_exit = WEXITSTATUS(status);
+			if (stats->last_exit == 0)
+				stats->success++;
+			else
+				stats->failure++;
+		} else {
+			stats->last_exit = 128 + WTERMSIG(status);
+			stats->signaled++;
+		}
+
+		// SIGTERM 을 무시한 셸의 자식이 남아있을 수 있으므로 프로세스 그룹을 마저 정리
+		// 그룹에 프로세스가 남아있는 동안은 pid 가 재사용되지 않음
+		if (run->timed_out)
+			kill(-run->pid, SIGKILL);
+
+		// 실행 중 리스트와 timeout 큐에서 제거
+		queue_remove(&expiring, run);
+		run->prev->next = run->next;
+		if (run->next != NULL)
+			run->next->prev = run->prev;
+		running_count--;
+		free(run->desc);
+		free(run);
+
+		// 이전 실행이 끝나길 기다리던 실행을 대기 큐로 돌려보냄
+		if (stats->live == 0 && stats->held_head != NULL) {
+			run = stats->held_head;
+			if ((stats->held_head = run->next) == NULL)
+				stats->held_tail = NULL;
+			stats->held--;
+			held_count--;
+			queue_push(&pending, run);
+		}
+	}
+
+	// 빈 자리만큼 대기 중인 명령어 실행
+	launch_pending();
 }
 
 // 디버깅용
 void test(crontab *ct, int min, int hour, int day, int month, int dayofweek) {
 	char buf[BUFSIZ];
-	if (parse_execute_term(ct->min, min) &&
-		parse_execute_term(ct->hour, hour) &&
-		parse_execute_term(ct->day, day) &&
-		parse_execute_term(ct->month, month) &&
-		parse_execute_term(ct->dayofweek, dayofweek)) {
+	struct tm when;
+
+	when.tm_min = min;
+	when.tm_hour = hour;
+	when.tm_mday = day;
+	when.tm_mon = month - 1;
+	when.tm_wday = dayofweek;
+	if (match_crontab(ct, &when)) {
 			sprintf(buf, "%s &", ct->op);
 			system(ct->op);
 	
-			sprintf(buf, "run %s %s %s %s %s %s\n", ct->min, ct->hour, ct->day, ct->dayofweek, ct->month, ct->op);
+			sprintf(buf, "run %s %s %s %s %s %s\n", ct->sched->min, ct->sched->hour, ct->sched->day,
+					ct->sched->dayofweek, ct->sched->month, ct->op);
 			log_crontab(buf);
 	}
 }
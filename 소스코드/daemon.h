@@ -0,0 +1,126 @@
+#ifndef H_DAEMON
+#define H_DAEMON 1
+
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "core.h"
+
+// 동시에 실행할 수 있는 명령어 수 기본값
+#define DEFAULT_MAX_JOBS 64
+
+// 멈춰있던 동안 놓친 실행을 몇 분 전까지 되살릴지 기본값
+#define DEFAULT_CATCHUP 10
+
+// 우선순위가 낮은 명령어를 호스트 부하 때문에 미룰 수 있는 최대 시간 (초) 기본값
+#define DEFAULT_DEFER_BUDGET 300
+
+// overlap=queue 인 명령어가 이전 실행을 기다리며 쌓일 수 있는 최대 수 (넘으면 버림)
+#define OVERLAP_QUEUE_MAX 16
+
+// timeout 이 지나 SIGTERM 을 보낸 뒤 SIGKILL 을 보낼 때까지 기다리는 시간 (초)
+#define TIMEOUT_GRACE 10
+
+// cpulimit 을 넘겨 SIGXCPU 를 받은 뒤 SIGKILL 을 받을 때까지 더 쓸 수 있는 CPU 시간 (초)
+#define CPU_LIMIT_GRACE 5
+
+// crontab_changed 가 알려주는 바뀐 파일
+#define CHANGED_FILE 1
+#define CHANGED_JOURNAL 2
+
+// 실행 대기 중이거나 실행 중인 명령어
+typedef struct job_run {
+	char *desc;					// 로그용 "주기 명령어" 복사본 (reload 로 노드가 사라져도 안전)
+	const char *op;				// desc 안의 명령어 부분
+	time_t sched;				// 원래 실행되어야 했던 시각
+	pid_t pid;
+	struct timespec start;		// 실행 시작 시각 (CLOCK_MONOTONIC)
+	struct timespec queued;		// 대기 큐에 들어간 시각 (daemon_clock 기준)
+	struct timespec launched;	// 실행 시작 시각 (daemon_clock 기준)
+	struct job_stats *stats;	// 이 명령어의 실행 통계
+	time_t release;				// 지터를 더한 실행 목표 시각
+	int priority;				// 실행 옵션의 우선순위
+	int deferred;				// 호스트 부하로 미뤄진 적이 있으면 1
+	int overlap;				// 이전 실행이 안 끝났을 때의 겹침 정책 (OVERLAP_*)
+	int replaced;				// 새 실행 때문에 종료시켰으면 1
+	job_limits limits;			// 프로세스에 걸 제한
+	time_t deadline;			// timeout 으로 시그널을 보낼 시각 (daemon_clock 기준)
+	int timed_out;				// timeout 으로 SIGTERM 을 보냈으면 1
+	int report;					// exec 전 실패를 읽을 파이프 (fork 로 실행하지 않았으면 -1)
+	unsigned long seq;			// 대기 큐에 들어간 순서
+	int queue_idx;				// 대기 큐, 지연 큐, timeout 큐 힙에서의 위치 (없으면 -1)
+	struct job_run *next, *prev;	// 실행 중 리스트 (이전 실행을 기다리는 동안은 next 만 씀)
+} job_run;
+
+// 명령어 힙 (실행 대기 큐, 지터 지연 큐, timeout 큐)
+typedef struct job_queue {
+	job_run **items;
+	int count;
+	int cap;
+	int (*before)(const job_run *a, const job_run *b);	// a 가 b 보다 먼저 꺼내져야 하면 1
+} job_queue;
+
+// reload 스레드가 만들어 스케줄러에 넘기는 테이블
+// 스케줄러가 가져간 뒤에는 예전 테이블을 담아서 reload 스레드에 돌려줌
+typedef struct table_snapshot {
+	crontab_table table;
+	unsigned long epoch;			// 스케줄러가 예전 테이블을 놓았을 때의 sched_epoch
+	unsigned long ctl_seq;			// 파일을 읽을 때 이미 저널에 쓰여 있던 마지막 제어 변경 번호
+	struct table_snapshot *next;	// 해제 대기 리스트
+} table_snapshot;
+
+extern crontab_table table;
+extern pthread_mutex_t table_lock;
+extern job_queue pending;
+extern job_queue delayed;
+extern job_queue expiring;
+extern int default_jitter;
+extern int default_overlap;
+extern int default_catchup;
+extern int held_count;
+extern job_run running;
+extern int running_count;
+extern int max_jobs;
+extern int catchup_window;
+extern double max_load;
+extern double max_mem_pressure;
+extern int defer_budget;
+extern double host_load;
+extern double host_mem_pressure;
+extern time_t admit_retry;
+extern schedule **heap;
+extern int heap_size;
+extern int (*daemon_clock)(struct timespec *ts);
+extern void (*launch_hook)(const job_run *run);
+
+time_t daemon_time();
+void init_daemon();
+void daemon_main();
+void *scheduler_main(void *arg);
+void print_log(const char *str);
+void heap_push(schedule *sp);
+schedule *heap_pop();
+void heap_remove(schedule *sp);
+void queue_push(job_queue *q, job_run *run);
+job_run *queue_pop(job_queue *q);
+void queue_remove(job_queue *q, job_run *run);
+int jitter_offset(const char *job, int window);
+int host_pressured(time_t now);
+void process_crontab(const crontab *ct, time_t sched);
+int launch_job(job_run *run);
+int split_command(const char *op, char *buf, char **argv);
+void launch_pending();
+void expire_timeouts(time_t now);
+void reconcile_state(time_t now);
+void reap_children(int fd);
+void test(crontab *ct, int min, int hour, int day, int month, int dayofweek);
+table_snapshot *build_crontab_table(time_t now);
+void adopt_crontab_table(table_snapshot *snap);
+int reload_crontab(time_t now);
+void dispatch_due(time_t now);
+void reschedule_all(time_t now);
+void arm_timer(int fd, time_t deadline);
+int watch_crontab(int *wd);
+int crontab_changed(int fd, int wd);
+
+#endif
@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "core.h"
+#include "daemon.h"
+#include "metrics.h"
+
+daemon_metrics metrics;
+
+// 메트릭 파일 경로 (NULL 이면 내보내지 않음)
+const char *metrics_file = METRICS_FILE;
+
+// 시간 히스토그램 구간 (초)
+const double time_bounds[METRICS_BUCKETS] = {
+	0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 60, 300, 3600
+};
+
+// 개수 히스토그램 구간
+const double count_bounds[METRICS_BUCKETS] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 5000, 10000
+};
+
+// 명령어 통계 해시 테이블 (실제로 실행된 명령어만 들어감)
+static job_stats **stats_slots;
+static size_t stats_size;	// 2의 거듭제곱
+static size_t stats_count;
+
+/**
+  문자열의 FNV-1a 해시를 구하는 함수
+  */
+static uint32_t __hash_str(const char *s) {
+	uint32_t h = 2166136261u;
+
+	for (; *s != '\0'; s++) {
+		h ^= (unsigned char) *s;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+  명령어 통계를 찾고 없으면 새로 만드는 함수
+  @param job "주기 명령어" 문자열
+  @return 명령어 통계
+  */
+job_stats *job_stats_get(const char *job) {
+	job_stats *sp, *next;
+	size_t slot;
+
+	// 평균 체인 길이가 1 을 넘지 않도록 키움
+	if (stats_count >= stats_size) {
+		size_t size = stats_size ? stats_size * 2 : 256;
+		job_stats **slots = calloc(size, sizeof(job_stats *));
+
+		for (size_t i = 0; i < stats_size; i++) {
+			for (sp = stats_slots[i]; sp != NULL; sp = next) {
+				next = sp->next;
+				slot = __hash_str(sp->job) & (size - 1);
+				sp->next = slots[slot];
+				slots[slot] = sp;
+			}
+		}
+		free(stats_slots);
+		stats_slots = slots;
+		stats_size = size;
+	}
+
+	slot = __hash_str(job) & (stats_size - 1);
+	for (sp = stats_slots[slot]; sp != NULL; sp = sp->next) {
+		if (!strcmp(sp->job, job))
+			return sp;
+	}
+
+	sp = calloc(1, sizeof(job_stats));
+	sp->job = strdup(job);
+	sp->last_exit = -1;
+	sp->state_idx = -1;
+	sp->next = stats_slots[slot];
+	stats_slots[slot] = sp;
+	stats_count++;
+	return sp;
+}
+
+/**
+  히스토그램에 값 하나를 더하는 함수
+  @param h 히스토그램
+  @param bounds 구간 상한들 (METRICS_BUCKETS 개, 오름차순)
+  @param value 관측 값
+  */
+void histogram_observe(histogram *h, const double *bounds, double value) {
+	for (int i = METRICS_BUCKETS - 1; i >= 0 && value <= bounds[i]; i--)
+		h->buckets[i]++;
+	h->count++;
+	h->sum += value;
+	metrics.dirty = 1;
+}
+
+/**
+  start 이후 지난 시간을 구하는 함수
+  @param start CLOCK_MONOTONIC 기준 시작 시각
+  @return 지난 시간 (초)
+  */
+double metrics_since(const struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+  실행 시각이 된 주기들을 처리한 한 번의 tick 을 기록하는 함수
+  @param start tick 시작 시각 (CLOCK_MONOTONIC)
+  @param due 대기 큐에 넣은 명령어 수
+  */
+void metrics_tick(const struct timespec *start, int due) {
+	histogram_observe(&metrics.tick, time_bounds, metrics_since(start));
+	histogram_observe(&metrics.due, count_bounds, due);
+	metrics.queued += due;
+}
+
+/**
+  Prometheus 라벨 값을 이스케이프해서 쓰는 함수
+  */
+static void __write_label(FILE *fp, const char *s) {
+	for (; *s != '\0'; s++) {
+		if (*s == '\\' || *s == '"')
+			fputc('\\', fp);
+		if (*s == '\n')
+			fputs("\\n", fp);
+		else
+			fputc(*s, fp);
+	}
+}
+
+/**
+  히스토그램 하나를 Prometheus 형식으로 쓰는 함수
+  @param name 메트릭 이름
+  @param job 명령어 라벨 (없으면 NULL)
+  */
+static void __write_histogram(FILE *fp, const char *name, const char *job,
+		const histogram *h, const double *bounds) {
+	for (int i = 0; i <= METRICS_BUCKETS; i++) {
+		fprintf(fp, "%s_bucket{", name);
+		if (job != NULL) {
+			fputs("job=\"", fp);
+			__write_label(fp, job);
+			fputs("\",", fp);
+		}
+		if (i < METRICS_BUCKETS)
+			fprintf(fp, "le=\"%g\"} %lu\n", bounds[i], (unsigned long) h->buckets[i]);
+		else
+			fprintf(fp, "le=\"+Inf\"} %lu\n", (unsigned long) h->count);
+	}
+
+	fprintf(fp, "%s_sum", name);
+	if (job != NULL) {
+		fputs("{job=\"", fp);
+		__write_label(fp, job);
+		fputs("\"}", fp);
+	}
+	fprintf(fp, " %.6f\n", h->sum);
+
+	fprintf(fp, "%s_count", name);
+	if (job != NULL) {
+		fputs("{job=\"", fp);
+		__write_label(fp, job);
+		fputs("\"}", fp);
+	}
+	fprintf(fp, " %lu\n", (unsigned long) h->count);
+}
+
+/**
+  명령어별 카운터 하나를 모든 명령어에 대해 쓰는 함수
+  @param name 메트릭 이름
+  @param type counter 또는 gauge
+  @param help 설명
+  @param offset job_stats 안의 값 위치
+  @param is_int 값이 int 면 1, uint64_t 면 0
+  */
+static void __write_job_values(FILE *fp, const char *name, const char *type, const char *help,
+		size_t offset, int is_int) {
+	job_stats *sp;
+
+	fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	for (size_t i = 0; i < stats_size; i++) {
+		for (sp = stats_slots[i]; sp != NULL; sp = sp->next) {
+			fprintf(fp, "%s{job=\"", name);
+			__write_label(fp, sp->job);
+			if (is_int)
+				fprintf(fp, "\"} %d\n", *(const int *) ((const char *) sp + offset));
+			else
+				fprintf(fp, "\"} %lu\n", (unsigned long) *(const uint64_t *) ((const char *) sp + offset));
+		}
+	}
+}
+
+/**
+  명령어별 히스토그램 하나를 모든 명령어에 대해 쓰는 함수
+  @param offset job_stats 안의 히스토그램 위치
+  */
+static void __write_job_histograms(FILE *fp, const char *name, const char *help, size_t offset) {
+	job_stats *sp;
+
+	fprintf(fp, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	for (size_t i = 0; i < stats_size; i++) {
+		for (sp = stats_slots[i]; sp != NULL; sp = sp->next)
+			__write_histogram(fp, name, sp->job,
+					(const histogram *) ((const char *) sp + offset), time_bounds);
+	}
+}
+
+/**
+  모든 메트릭을 Prometheus 텍스트 형식 파일로 쓰는 함수 (스케줄러 스레드)
+  임시 파일에 쓴 뒤 rename 하므로 수집기가 반쯤 쓰인 파일을 읽지 않음
+  @param path 메트릭 파일 경로
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+int metrics_write(const char *path) {
+	static const char *results[] = { "success", "failure", "signal", "spawn_error" };
+	static const size_t result_offsets[] = {
+		offsetof(job_stats, success), offsetof(job_stats, failure),
+		offsetof(job_stats, signaled), offsetof(job_stats, spawn_error)
+	};
+	char tmpname[BUF_SIZE];
+	job_stats *sp;
+	FILE *fp;
+	int fd;
+
+	sprintf(tmpname, "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmpname)) < 0 || (fp = fdopen(fd, "w")) == NULL) {
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmpname);
+		}
+		sprintf(err_str, "[metrics_write] mkstemp error\n");
+		return -1;
+	}
+	fchmod(fd, 0644);
+
+	fprintf(fp, "# HELP ssu_crond_table_entries Entries in the loaded crontab.\n"
+			"# TYPE ssu_crond_table_entries gauge\nssu_crond_table_entries %d\n", table.count);
+	fprintf(fp, "# HELP ssu_crond_table_schedules Distinct schedules in the loaded crontab.\n"
+			"# TYPE ssu_crond_table_schedules gauge\nssu_crond_table_schedules %d\n", table.sched_count);
+	fprintf(fp, "# HELP ssu_crond_jobs_running Commands currently running.\n"
+			"# TYPE ssu_crond_jobs_running gauge\nssu_crond_jobs_running %d\n", running_count);
+	fprintf(fp, "# HELP ssu_crond_jobs_pending Commands waiting for a free slot.\n"
+			"# TYPE ssu_crond_jobs_pending gauge\nssu_crond_jobs_pending %d\n", pending.count);
+	fprintf(fp, "# HELP ssu_crond_jobs_delayed Due commands waiting for their jitter offset.\n"
+			"# TYPE ssu_crond_jobs_delayed gauge\nssu_crond_jobs_delayed %d\n", delayed.count);
+	fprintf(fp, "# HELP ssu_crond_jobs_held Due commands waiting for their previous run to finish.\n"
+			"# TYPE ssu_crond_jobs_held gauge\nssu_crond_jobs_held %d\n", held_count);
+	fprintf(fp, "# HELP ssu_crond_max_jobs Concurrent command limit.\n"
+			"# TYPE ssu_crond_max_jobs gauge\nssu_crond_max_jobs %d\n", max_jobs);
+	fprintf(fp, "# HELP ssu_crond_host_load_per_cpu Last 1-minute load average per CPU read for admission.\n"
+			"# TYPE ssu_crond_host_load_per_cpu gauge\nssu_crond_host_load_per_cpu %.3f\n", host_load);
+	fprintf(fp, "# HELP ssu_crond_host_memory_pressure Last memory PSI some avg10 read for admission.\n"
+			"# TYPE ssu_crond_host_memory_pressure gauge\nssu_crond_host_memory_pressure %.2f\n",
+			host_mem_pressure);
+	fprintf(fp, "# HELP ssu_crond_jobs_queued_total Commands queued because they were due.\n"
+			"# TYPE ssu_crond_jobs_queued_total counter\nssu_crond_jobs_queued_total %lu\n",
+			(unsigned long) metrics.queued);
+	fprintf(fp, "# HELP ssu_crond_reloads_total Crontab tables read.\n"
+			"# TYPE ssu_crond_reloads_total counter\nssu_crond_reloads_total %lu\n",
+			(unsigned long) atomic_load(&metrics.reloads));
+	fprintf(fp, "# HELP ssu_crond_reload_parse_seconds Time to read and compile the last table.\n"
+			"# TYPE ssu_crond_reload_parse_seconds gauge\nssu_crond_reload_parse_seconds %.6f\n",
+			atomic_load(&metrics.parse_ns) / 1e9);
+	fprintf(fp, "# HELP ssu_crond_reload_adopt_seconds Scheduler time to switch to the last table.\n"
+			"# TYPE ssu_crond_reload_adopt_seconds gauge\nssu_crond_reload_adopt_seconds %.6f\n",
+			metrics.adopt_ns / 1e9);
+
+	fprintf(fp, "# HELP ssu_crond_tick_duration_seconds Time to pop due schedules and queue their commands.\n"
+			"# TYPE ssu_crond_tick_duration_seconds histogram\n");
+	__write_histogram(fp, "ssu_crond_tick_duration_seconds", NULL, &metrics.tick, time_bounds);
+	fprintf(fp, "# HELP ssu_crond_tick_jobs_due Commands queued per tick.\n"
+			"# TYPE ssu_crond_tick_jobs_due histogram\n");
+	__write_histogram(fp, "ssu_crond_tick_jobs_due", NULL, &metrics.due, count_bounds);
+
+	__write_job_values(fp, "ssu_crond_job_runs_total", "counter",
+			"Times the command was started.", offsetof(job_stats, runs), 0);
+	__write_job_values(fp, "ssu_crond_job_skips_total", "counter",
+			"Missed runs dropped by the catch-up window or policy.", offsetof(job_stats, skips), 0);
+	__write_job_values(fp, "ssu_crond_job_overlaps_total", "counter",
+			"Starts while a previous run of the command was still running.", offsetof(job_stats, overlaps), 0);
+	__write_job_values(fp, "ssu_crond_job_deferrals_total", "counter",
+			"Runs held back by load-aware admission.", offsetof(job_stats, deferrals), 0);
+	__write_job_values(fp, "ssu_crond_job_overlap_skips_total", "counter",
+			"Runs dropped because a previous run was still running.", offsetof(job_stats, overlap_skips), 0);
+	__write_job_values(fp, "ssu_crond_job_replaced_total", "counter",
+			"Previous runs terminated to make room for a new run.", offsetof(job_stats, replaced), 0);
+	__write_job_values(fp, "ssu_crond_job_timeouts_total", "counter",
+			"Runs terminated because they exceeded their timeout.", offsetof(job_stats, timeouts), 0);
+	__write_job_values(fp, "ssu_crond_job_held", "gauge",
+			"Runs waiting for a previous run of the command to finish.", offsetof(job_stats, held), 1);
+	__write_job_values(fp, "ssu_crond_job_running", "gauge",
+			"Runs of the command currently running.", offsetof(job_stats, live), 1);
+	__write_job_values(fp, "ssu_crond_job_last_exit_code", "gauge",
+			"Exit code of the last run (128 + signal if killed, -1 if none).", offsetof(job_stats, last_exit), 1);
+
+	fprintf(fp, "# HELP ssu_crond_job_exits_total Finished runs by result.\n"
+			"# TYPE ssu_crond_job_exits_total counter\n");
+	for (size_t i = 0; i < stats_size; i++) {
+		for (sp = stats_slots[i]; sp != NULL; sp = sp->next) {
+			for (int r = 0; r < 4; r++) {
+				fputs("ssu_crond_job_exits_total{job=\"", fp);
+				__write_label(fp, sp->job);
+				fprintf(fp, "\",result=\"%s\"} %lu\n", results[r],
+						(unsigned long) *(const uint64_t *) ((const char *) sp + result_offsets[r]));
+			}
+		}
+	}
+
+	__write_job_histograms(fp, "ssu_crond_job_trigger_lateness_seconds",
+			"Delay from the scheduled minute until the command was queued.", offsetof(job_stats, lateness));
+	__write_job_histograms(fp, "ssu_crond_job_launch_latency_seconds",
+			"Delay from queueing until the process was started.", offsetof(job_stats, launch_latency));
+	__write_job_histograms(fp, "ssu_crond_job_duration_seconds",
+			"Run time of finished commands.", offsetof(job_stats, duration));
+
+	if (fclose(fp) != 0 || rename(tmpname, path) < 0) {
+		sprintf(err_str, "[metrics_write] write error for %s\n", path);
+		unlink(tmpname);
+		return -1;
+	}
+
+	metrics.dirty = 0;
+	return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef H_METRICS
+#define H_METRICS 1
+
+#include <stdint.h>
+#include <time.h>
+
+// Prometheus 텍스트 형식 메트릭 파일 기본 경로 (node_exporter textfile collector 로 수집)
+#define METRICS_FILE "ssu_crond.prom"
+
+// 메트릭 파일을 다시 쓰는 최소 간격 (초)
+#define METRICS_INTERVAL 5
+
+// 히스토그램 구간 수 (+Inf 제외)
+#define METRICS_BUCKETS 12
+
+// 누적 히스토그램 (buckets[i] 는 bounds[i] 이하인 관측 수, +Inf 는 count)
+typedef struct histogram {
+	uint64_t buckets[METRICS_BUCKETS];
+	uint64_t count;
+	double sum;
+} histogram;
+
+// 명령어 하나의 실행 통계
+// "주기 명령어" 문자열로 찾으므로 reload 로 테이블이 바뀌어도 이어서 쌓임
+typedef struct job_stats {
+	char *job;					// "주기 명령어"
+	uint64_t runs;				// 실행 시작 수
+	uint64_t skips;				// catch-up 범위를 벗어나거나 catch-up 정책으로 버린 실행 수
+	uint64_t overlaps;			// 이전 실행이 끝나기 전에 시작한 수
+	uint64_t success;			// exit 0
+	uint64_t failure;			// 0 이 아닌 exit
+	uint64_t signaled;			// 시그널로 종료
+	uint64_t spawn_error;		// 실행 자체를 못한 수
+	uint64_t deferrals;			// 호스트 부하로 미뤄진 실행 수
+	uint64_t overlap_skips;		// 이전 실행이 안 끝나서 버린 실행 수
+	uint64_t replaced;			// 새 실행 때문에 종료시킨 이전 실행 수
+	uint64_t timeouts;			// timeout 이 지나 종료시킨 실행 수
+	int last_exit;				// 마지막 exit 코드 (시그널이면 128 + 시그널 번호, 없으면 -1)
+	int live;					// 지금 실행 중인 수
+	int held;					// 이전 실행이 끝나길 기다리는 실행 수
+	int state_idx;				// 상태 파일 레코드 번호 (-1 이면 아직 찾지 않음)
+	struct job_run *held_head;	// 기다리는 실행들 (먼저 온 순서, job_run.next 로 연결)
+	struct job_run *held_tail;
+	histogram lateness;			// 실행 시각 -> 대기 큐에 들어간 시각
+	histogram launch_latency;	// 대기 큐에 들어간 시각 -> 실행 시작
+	histogram duration;			// 실행 시작 -> 종료
+	struct job_stats *next;		// 해시 체인
+} job_stats;
+
+// daemon 전체 통계
+// reload 관련 값만 reload 스레드가 쓰고 나머지는 스케줄러 스레드만 씀
+typedef struct daemon_metrics {
+	histogram tick;				// 실행할 주기를 꺼내 대기 큐에 넣는 데 걸린 시간
+	histogram due;				// 한 번에 대기 큐에 들어간 명령어 수
+	uint64_t queued;			// 대기 큐에 들어간 명령어 수
+	_Atomic uint64_t reloads;	// 읽은 테이블 수
+	_Atomic int64_t parse_ns;	// 마지막으로 테이블을 읽고 컴파일하는 데 걸린 시간
+	int64_t adopt_ns;			// 마지막으로 테이블을 바꾸는 데 걸린 시간
+	int dirty;					// 마지막으로 파일을 쓴 뒤 바뀐 값이 있으면 1
+} daemon_metrics;
+
+extern daemon_metrics metrics;
+extern const char *metrics_file;
+
+job_stats *job_stats_get(const char *job);
+void histogram_observe(histogram *h, const double *bounds, double value);
+double metrics_since(const struct timespec *start);
+void metrics_tick(const struct timespec *start, int due);
+int metrics_write(const char *path);
+
+extern const double time_bounds[METRICS_BUCKETS];
+extern const double count_bounds[METRICS_BUCKETS];
+
+#endif
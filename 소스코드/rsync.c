@@ -14,6 +14,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 
+#define RSYNC_LOG "ssu_rsync_log"
 #define USAGE "usage: ssu_rsync [option] <src> <dest>\n\t-r : recursive sync\n\t-t : sync using tar\n\t-m : Fully sync\n"
 
 typedef struct node {
@@ -415,9 +416,9 @@ void onexit() {
 
 /**
   SIGINT 캐치함수
+  exit 로 끝내서 atexit 에 등록된 onexit 가 백업을 복원하거나 삭제하게 함
   */
 void on_sigint(int sig) {
-	//onexit();
 	exit(0);
 }
 
@@ -1109,27 +1110,16 @@ void sync_dir(int argc, char *argv[], const char *src, const char *dest, int rop
   @param str 로그 내용
   */
 void log_rsync(int argc, char *argv[], const char *str) {
-	FILE *fp;
-	time_t t;
 	char buf[BUF_SIZE];
 
-	t = time(NULL);
-
-	if ((fp = fopen("ssu_rsync_log", "a+")) == NULL) {
-		fprintf(stderr, "open error for ssu_rsync_log\n");
-		exit(1);
-	}
-
 	strcpy(buf, "ssu_rsync");
 	for (int i = 1; i < argc; i++) {
 		strcat(buf, " ");
 		strcat(buf, argv[i]);
 	}
 
-	fprintf(fp, "[%s] %s\n%s\n",
-			strtok(ctime(&t), "\n"),
-			buf,
-			str
-	);
-	fclose(fp);
+	if (log_printf(RSYNC_LOG, "%s\n%s\n", buf, str) < 0) {
+		fprintf(stderr, "open error for %s\n", RSYNC_LOG);
+		exit(1);
+	}
 }
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "core.h"
+#include "state.h"
+
+// 상태 파일 경로 (NULL 이면 상태를 남기지 않음)
+const char *state_file = STATE_FILE;
+
+// mmap 한 상태 파일 (열지 않았으면 NULL)
+// 파일에 바로 쓰므로 daemon 이 죽어도 마지막으로 쓴 값이 남음
+static state_header *state_map;
+static state_record *records;
+static size_t state_len;
+static int state_fd = -1;
+
+// 키 -> 레코드 번호 해시 테이블 (linear probing, 빈 자리는 -1)
+static int *state_index;
+static size_t index_size;	// 2의 거듭제곱
+
+/**
+  문자열의 64비트 FNV-1a 해시를 구하는 함수
+  */
+static uint64_t __hash_key(const char *s) {
+	uint64_t h = 14695981039346656037ULL;
+
+	for (; *s != '\0'; s++) {
+		h ^= (unsigned char) *s;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/**
+  상태 파일을 cap 개의 레코드 자리만큼 늘리고 다시 mmap 하는 함수
+  @param cap 레코드 자리 수
+  @return 성공 시 0, 에러 시 -1 리턴하고 err_str 설정
+  */
+static int __map_state(uint32_t cap) {
+	size_t len = sizeof(state_header) + (size_t) cap * sizeof(state_record);
+	void *p;
+
+	if (ftruncate(state_fd, len) < 0) {
+		sprintf(err_str, "[state] ftruncate error\n");
+		return -1;
+	}
+	if ((p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, state_fd, 0)) == MAP_FAILED) {
+		sprintf(err_str, "[state] mmap error\n");
+		return -1;
+	}
+
+	if (state_map != NULL)
+		munmap(state_map, state_len);
+	state_map = p;
+	records = (state_record *) (state_map + 1);
+	state_len = len;
+	state_map->cap = cap;
+	return 0;
+}
+
+/**
+  레코드 번호를 키 해시 테이블에 넣는 함수
+  */
+static void __index_insert(int idx) {
+	size_t slot = records[idx].key & (index_size - 1);
+
+	while (state_index[slot] >= 0)
+		slot = (slot + 1) & (index_size - 1);
+	state_index[slot] = idx;
+}
+
+/**
+  레코드 수에 맞게 키 해시 테이블을 다시 만드는 함수
+  */
+static void __rebuild_index() {
+	size_t size = 256;
+
+	while (size < (size_t) state_map->cap * 2)
+		size <<= 1;
+
+	free(state_index);
+	state_index = malloc(size * sizeof(int));
+	memset(state_index, -1, size * sizeof(int));
+	index_size = size;
+	for (uint32_t i = 0; i < state_map->count; i++)
+		__index_insert(i);
+}
+
+/**
+  상태 파일을 열어서 mmap 하는 함수 (다른 스레드를 만들기 전에 부름)
+  없거나 형식이 맞지 않는 파일은 빈 상태 파일로 새로 만듦
+  @param path 상태 파일 경로
+  @return 이전 상태를 읽었으면 0, 새로 만들었으면 1, 에러 시 -1 리턴하고 err_str 설정
+  */
+int state_open(const char *path) {
+	struct stat st;
+	state_header hdr;
+	int fresh;
+
+	if ((state_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 || fstat(state_fd, &st) < 0) {
+		sprintf(err_str, "[state] open error for %s\n", path);
+		return -1;
+	}
+
+	// 헤더가 맞고 파일 크기가 헤더의 레코드 자리 수와 맞아야 이전 상태로 씀
+	fresh = pread(state_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+		|| memcmp(hdr.magic, STATE_MAGIC, sizeof(hdr.magic)) != 0
+		|| hdr.cap == 0 || hdr.count > hdr.cap
+		|| (size_t) st.st_size != sizeof(state_header) + (size_t) hdr.cap * sizeof(state_record);
+
+	if (fresh) {
+		if (ftruncate(state_fd, 0) < 0 || __map_state(STATE_INITIAL_CAP) < 0) {
+			close(state_fd);
+			state_fd = -1;
+			return -1;
+		}
+		memcpy(state_map->magic, STATE_MAGIC, sizeof(state_map->magic));
+		state_map->count = 0;
+	} else if (__map_state(hdr.cap) < 0) {
+		close(state_fd);
+		state_fd = -1;
+		return -1;
+	}
+
+	__rebuild_index();
+	return fresh;
+}
+
+/**
+  명령어의 상태 레코드 번호를 찾는 함수 (스케줄러 스레드)
+  레코드를 새로 만들면 실행 시각은 0 으로 채워짐
+  @param job "주기 명령어" 문자열
+  @param create 없으면 새로 만들지 여부
+  @return 레코드 번호, 없거나 상태 파일을 열지 않았으면 -1
+  */
+int state_find(const char *job, int create) {
+	uint64_t key;
+	size_t slot;
+	int idx;
+
+	if (state_map == NULL)
+		return -1;
+
+	key = __hash_key(job);
+	for (slot = key & (index_size - 1); (idx = state_index[slot]) >= 0; slot = (slot + 1) & (index_size - 1)) {
+		if (records[idx].key == key)
+			return idx;
+	}
+	if (!create)
+		return -1;
+
+	// 가득 차면 파일을 두 배로 늘림 (레코드 번호는 그대로)
+	if (state_map->count == state_map->cap) {
+		if (__map_state(state_map->cap * 2) < 0)
+			return -1;
+		__rebuild_index();
+	}
+
+	// 레코드를 다 쓴 뒤에 수를 늘려서 반쯤 쓰인 레코드가 읽히지 않게 함
+	idx = state_map->count;
+	records[idx].key = key;
+	records[idx].last_sched = 0;
+	records[idx].last_done = 0;
+	state_map->count = idx + 1;
+	__index_insert(idx);
+	return idx;
+}
+
+/**
+  레코드 번호로 상태 레코드를 구하는 함수
+  파일을 늘리면 주소가 바뀌므로 포인터를 들고 있지 말고 번호를 들고 있어야 함
+  @param idx state_find 로 찾은 레코드 번호
+  @return 상태 레코드
+  */
+state_record *state_at(int idx) {
+	return &records[idx];
+}
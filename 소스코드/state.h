@@ -0,0 +1,35 @@
+#ifndef H_STATE
+#define H_STATE 1
+
+#include <stdint.h>
+
+// 명령어별 마지막 실행 상태 파일 기본 경로
+#define STATE_FILE "ssu_crond.state"
+
+// 상태 파일 맨 앞의 식별 문자열 (형식이 바뀌면 숫자를 올림)
+#define STATE_MAGIC "SSUCRST1"
+
+// 새 상태 파일의 레코드 자리 수 (가득 차면 두 배로 늘림)
+#define STATE_INITIAL_CAP 1024
+
+// 상태 파일 헤더 (뒤에 state_record 가 cap 개 이어짐)
+typedef struct state_header {
+	char magic[8];
+	uint32_t count;			// 쓰인 레코드 수
+	uint32_t cap;			// 파일에 자리가 잡힌 레코드 수
+} state_header;
+
+// 명령어 하나의 마지막 실행 상태
+typedef struct state_record {
+	uint64_t key;			// "주기 명령어" 문자열 해시
+	int64_t last_sched;		// 마지막으로 실행을 시작한 실행 시각
+	int64_t last_done;		// 마지막으로 실행이 끝난 시각 (없으면 0)
+} state_record;
+
+extern const char *state_file;
+
+int state_open(const char *path);
+int state_find(const char *job, int create);
+state_record *state_at(int idx);
+
+#endif